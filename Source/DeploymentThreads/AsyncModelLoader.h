@@ -0,0 +1,178 @@
+#pragma once
+
+#include "shared_plugin_helpers/shared_plugin_helpers.h"
+#include "ModelLoader.h"
+#include "SharedModelRegistry.h"
+#include "TorchThreading.h"
+
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+
+/*
+ * Loads, prepares (freeze/optimize/warm-up) and validates models on a background thread so
+ * that the DeploymentThread never blocks on torch::jit::load.
+ *
+ * The DPL thread requests a model with requestLoad() and keeps serving the current model.
+ * Once the new one is ready, takeReadyModel() hands it over; the DPL thread calls this at the
+ * top of every iteration (i.e. never in the middle of a deploy() call) and swaps it in.
+ *
+ * If reload_on_file_change is enabled, the file of the last requested model is watched and
+ * reloaded whenever its modification time changes (e.g. after re-exporting the model).
+ *
+ * The state of the last request for every path is kept (pending, failed or ready), so that
+ * a failed load is reported to the caller instead of looking like the model is loaded.
+ */
+class AsyncModelLoader : public juce::Thread {
+public:
+    enum class RequestState { Pending, Failed, Ready };
+
+    struct LoadedModel {
+        std::string model_name;
+        std::string model_path;
+        torch::jit::script::Module module;
+        torch::ScalarType floating_dtype{torch::kFloat32};
+        // set if the model is shared with other plugin instances
+        std::shared_ptr<const SharedModel> shared;
+    };
+
+    AsyncModelLoader(bool reload_on_file_change_, int file_watch_interval_ms_) :
+        juce::Thread("BackgroundModelLoaderThread"),
+        reload_on_file_change(reload_on_file_change_),
+        file_watch_interval_ms(std::max(10, file_watch_interval_ms_)) {}
+
+    // a load in progress can't be interrupted (torch::jit::load, warm-up), so wait for it instead of
+    // letting juce kill the thread in the middle of it
+    ~AsyncModelLoader() override { stopThread(-1); }
+
+    void requestLoad(const std::string& model_name, const std::string& model_path) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            requested = Request{model_name, model_path};
+            request_states[model_path] = RequestState::Pending;
+        }
+        if (!isThreadRunning()) { startThread(); }
+        notify();
+    }
+
+    // returns the newly loaded model (only once), or nullopt if nothing new is available
+    std::optional<LoadedModel> takeReadyModel() {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto model = std::move(ready);
+        ready.reset();
+        // handed over, a later request for the same path loads it again
+        if (model.has_value()) { request_states.erase(model->model_path); }
+        return model;
+    }
+
+    [[nodiscard]] bool isLoading() const { return is_loading; }
+
+    // state of the last request for model_path (nullopt if it was never requested)
+    [[nodiscard]] std::optional<RequestState> getRequestState(const std::string& model_path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = request_states.find(model_path);
+        if (it == request_states.end()) { return std::nullopt; }
+        return it->second;
+    }
+
+    void run() override {
+        std::optional<Request> watched;
+        std::optional<std::filesystem::file_time_type> watched_mtime;
+
+        while (!threadShouldExit()) {
+            std::optional<Request> request;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                request = std::move(requested);
+                requested.reset();
+            }
+
+            // reload the watched model if its file changed since it was last loaded
+            if (!request.has_value() && reload_on_file_change && watched.has_value()) {
+                auto mtime = getModificationTime(watched->model_path);
+                if (mtime.has_value() && mtime != watched_mtime) {
+                    // wait one more interval so that we don't load a file that is still being written
+                    wait(file_watch_interval_ms);
+                    if (getModificationTime(watched->model_path) == mtime) {
+                        cout << "Model file changed on disk: " << watched->model_path << " -- Reloading..." << endl;
+                        request = watched;
+                        std::lock_guard<std::mutex> lock(mutex);
+                        request_states[watched->model_path] = RequestState::Pending;
+                    }
+                }
+            }
+
+            if (request.has_value()) {
+                watched = request;
+                watched_mtime = getModificationTime(request->model_path);
+                loadInBackground(*request);
+            }
+
+            wait(reload_on_file_change ? file_watch_interval_ms : -1);
+        }
+    }
+
+private:
+    struct Request {
+        std::string model_name;
+        std::string model_path;
+    };
+
+    bool reload_on_file_change;
+    int file_watch_interval_ms;
+
+    std::mutex mutex;
+    std::optional<Request> requested;
+    std::optional<LoadedModel> ready;
+    std::map<std::string, RequestState> request_states;
+    std::atomic<bool> is_loading{false};
+
+    void setRequestState(const std::string& model_path, RequestState state) {
+        std::lock_guard<std::mutex> lock(mutex);
+        request_states[model_path] = state;
+    }
+
+    void loadInBackground(const Request& request) {
+        is_loading = true;
+        try {
+            auto settings = get_model_load_settings(request.model_name);
+            auto floating_dtype = torch::kFloat32;
+            std::shared_ptr<const SharedModel> shared;
+            torch::jit::script::Module module;
+            if (deployment_settings::ModelSharing::share_across_instances) {
+                shared = SharedModelRegistry::instance().acquire(request.model_path, request.model_name);
+                module = shared->module;
+                floating_dtype = shared->floating_dtype;
+            } else {
+                module = load_and_prepare_model(request.model_path, settings, &floating_dtype);
+                benchmark_torch_thread_counts_if_enabled(module, request.model_path, request.model_name,
+                                                         floating_dtype);
+            }
+            // shutting down, skip the validation (runs the model once more)
+            if (threadShouldExit()) {
+                is_loading = false;
+                return;
+            }
+            if (validate_model(module, request.model_path, settings, floating_dtype)) {
+                std::lock_guard<std::mutex> lock(mutex);
+                ready = LoadedModel{request.model_name, request.model_path, module, floating_dtype, shared};
+                request_states[request.model_path] = RequestState::Ready;
+                cout << "Model loaded in background: " << request.model_path << endl;
+            } else {
+                setRequestState(request.model_path, RequestState::Failed);
+            }
+        } catch (const std::exception& e) {
+            setRequestState(request.model_path, RequestState::Failed);
+            cout << "Failed to load model at " << request.model_path << ": " << e.what() << endl;
+        }
+        is_loading = false;
+    }
+
+    static std::optional<std::filesystem::file_time_type> getModificationTime(const std::string& path) {
+        std::error_code ec;
+        auto mtime = std::filesystem::last_write_time(path, ec);
+        if (ec) { return std::nullopt; }
+        return mtime;
+    }
+};
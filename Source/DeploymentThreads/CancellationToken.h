@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <optional>
+#include <stdexcept>
+
+// thrown by DeploymentThread::forward() (and the inference backends) once the running deploy()
+// call has been cancelled, so that autoregressive loops unwind without extra checks
+struct InferenceCancelled : public std::runtime_error {
+    InferenceCancelled() : std::runtime_error("inference cancelled, newer input is available") {}
+};
+
+/*
+ * Flag shared between the DPL thread and the code running the current deploy() call
+ * (including inference jobs on worker threads). Tripped by the DPL thread when higher
+ * priority input (notes, gui changes, playback stop) arrives while deploy() is still running.
+ */
+class CancellationToken {
+public:
+    void cancel() { cancelled.store(true, std::memory_order_release); }
+    void reset() { cancelled.store(false, std::memory_order_release); }
+
+    [[nodiscard]] bool isCancelled() const { return cancelled.load(std::memory_order_acquire); }
+
+    void throwIfCancelled() const {
+        if (isCancelled()) { throw InferenceCancelled(); }
+    }
+
+private:
+    std::atomic<bool> cancelled{false};
+};
+
+// Waits for the future while polling should_cancel every poll_interval.
+// Returns std::nullopt if cancelled (the job itself keeps running until it checks the token).
+template <typename T>
+std::optional<T> wait_for_result(std::future<T>& future, const std::function<bool()>& should_cancel,
+                                 std::chrono::microseconds poll_interval = std::chrono::milliseconds(1)) {
+    while (future.wait_for(poll_interval) != std::future_status::ready) {
+        if (should_cancel()) { return std::nullopt; }
+    }
+    return future.get();
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "../Includes/InputEvent.h"
+#include "../Includes/GenerationEvent.h"
+
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <sstream>
+
+/*
+ * Musical deadline for a single deploy() call.
+ *
+ * By default the deadline is the start of the first bar after the triggering EventFromHost
+ * (i.e. the moment a "generate the next bar" model has to be ready by). deploy() can
+ * override it using DeploymentThread::setDeployDeadline().
+ */
+struct DeployDeadline {
+    int64_t time_in_samples{-1};
+
+    // needed for re-anchoring (not available if the deadline was set manually)
+    double bar_duration_in_samples{-1};
+    double bar_duration_in_ppq{-1};
+    double sample_rate{-1};
+
+    static std::optional<DeployDeadline> nextBarAfter(const EventFromHost& event) {
+        auto meta = event.getBufferMetaData();
+        if (meta.qpm <= 0 || meta.numerator <= 0 || meta.denominator <= 0 || meta.sample_rate <= 0) {
+            return std::nullopt;
+        }
+
+        auto now = event.Time();
+        if (now.inSamples() < 0 || now.inQuarterNotes() < 0) { return std::nullopt; }
+
+        DeployDeadline deadline;
+        deadline.sample_rate = meta.sample_rate;
+        deadline.bar_duration_in_ppq = meta.numerator * 4.0 / meta.denominator;
+        deadline.bar_duration_in_samples = deadline.bar_duration_in_ppq * 60.0 / meta.qpm * meta.sample_rate;
+
+        auto next_bar_ppq = meta.nextBarStartInQuarterNotes(now.inQuarterNotes());
+        auto samples_until_bar = (next_bar_ppq - now.inQuarterNotes()) * 60.0 / meta.qpm * meta.sample_rate;
+        deadline.time_in_samples = now.inSamples() + (int64_t) std::llround(samples_until_bar);
+        return deadline;
+    }
+
+    static DeployDeadline atSample(int64_t time_in_samples_) {
+        DeployDeadline deadline;
+        deadline.time_in_samples = time_in_samples_;
+        return deadline;
+    }
+
+    [[nodiscard]] bool canBeReanchored() const {
+        return bar_duration_in_samples > 0 && bar_duration_in_ppq > 0 && sample_rate > 0;
+    }
+};
+
+/*
+ * What to do with a generation that is ready only after its deadline has passed:
+ *
+ *  keep     --> send it anyway (previous behaviour)
+ *  drop     --> don't send the PlaybackSequence
+ *  reanchor --> shift the sequence by as many whole bars as needed for the deadline to be in
+ *               the future again (only for sequences anchored to absolute zero or playback
+ *               start, sequences relative to now are sent unchanged)
+ */
+enum class DeadlineMissPolicy { Keep, Drop, Reanchor };
+
+inline DeadlineMissPolicy parse_deadline_miss_policy(const std::string& policy) {
+    if (policy == "drop") { return DeadlineMissPolicy::Drop; }
+    if (policy == "reanchor") { return DeadlineMissPolicy::Reanchor; }
+    return DeadlineMissPolicy::Keep;
+}
+
+struct DeadlineStats {
+    int64_t num_on_time{0};
+    int64_t num_missed{0};
+    int64_t num_dropped{0};
+    int64_t num_reanchored{0};
+    double worst_lateness_ms{0};
+
+    [[nodiscard]] double getMissRate() const {
+        auto total = num_on_time + num_missed;
+        return total > 0 ? double(num_missed) / double(total) : 0.0;
+    }
+};
+
+// keeps the deadline stats separately for every model served by the thread
+class DeadlineTracker {
+public:
+    explicit DeadlineTracker(DeadlineMissPolicy policy_) : policy(policy_) {}
+
+    // Returns true if the sequence should be sent. Reanchors the sequence in place if needed.
+    bool evaluate(const std::string& model_path, const DeployDeadline& deadline,
+                  const BufferMetaData& now, const PlaybackPolicies& playback_policy,
+                  PlaybackSequence& sequence) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& stats = stats_per_model[model_path];
+
+        if (!now.isPlaying || now.time_in_samples < 0 || now.time_in_samples <= deadline.time_in_samples) {
+            stats.num_on_time++;
+            return true;
+        }
+
+        stats.num_missed++;
+        auto late_samples = double(now.time_in_samples - deadline.time_in_samples);
+        if (now.sample_rate > 0) {
+            stats.worst_lateness_ms = std::max(stats.worst_lateness_ms, late_samples / now.sample_rate * 1000.0);
+        }
+
+        switch (policy) {
+            case DeadlineMissPolicy::Drop:
+                stats.num_dropped++;
+                return false;
+            case DeadlineMissPolicy::Reanchor:
+                if (deadline.canBeReanchored() && !playback_policy.IsPlaybackPolicy_RelativeToNow()) {
+                    auto num_bars = std::ceil(late_samples / deadline.bar_duration_in_samples);
+                    if (playback_policy.IsTimeUnitIsAudioSamples()) {
+                        sequence.shiftAllEventsBy(num_bars * deadline.bar_duration_in_samples);
+                    } else if (playback_policy.IsTimeUnitIsSeconds()) {
+                        sequence.shiftAllEventsBy(num_bars * deadline.bar_duration_in_samples / deadline.sample_rate);
+                    } else {
+                        sequence.shiftAllEventsBy(num_bars * deadline.bar_duration_in_ppq);
+                    }
+                    stats.num_reanchored++;
+                }
+                return true;
+            case DeadlineMissPolicy::Keep:
+            default:
+                return true;
+        }
+    }
+
+    [[nodiscard]] std::map<std::string, DeadlineStats> getStats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats_per_model;
+    }
+
+    [[nodiscard]] int64_t getTotalNumMissed() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        int64_t total = 0;
+        for (const auto& [model_path, stats] : stats_per_model) { total += stats.num_missed; }
+        return total;
+    }
+
+    [[nodiscard]] std::string getDescription() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::stringstream ss;
+        ss << "Deploy Deadlines";
+        for (const auto& [model_path, stats] : stats_per_model) {
+            ss << std::endl << "    " << (model_path.empty() ? "(no model)" : model_path);
+            ss << " | on time: " << stats.num_on_time << " | missed: " << stats.num_missed;
+            ss << " (" << stats.getMissRate() * 100.0 << " %)";
+            ss << " | dropped: " << stats.num_dropped << " | reanchored: " << stats.num_reanchored;
+            ss << " | worst lateness: " << stats.worst_lateness_ms << " ms";
+        }
+        return ss.str();
+    }
+
+private:
+    DeadlineMissPolicy policy;
+    std::map<std::string, DeadlineStats> stats_per_model;
+    mutable std::mutex mutex;
+};
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <torch/script.h> // One-stop header.
+#include <torch/csrc/autograd/profiler_kineto.h>
+#include <ATen/ThreadLocalState.h>
+#include "../Includes/colored_cout.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+ * Operator-level profiling of deploy() calls using the libtorch (kineto) profiler,
+ * see deployment_settings.profiling.
+ *
+ * After skip_first_n_calls deploy() calls of a newly installed model, the next
+ * num_deploy_calls calls are recorded on the DPL thread. The profiler is thread local, so inference
+ * jobs carry the DPL thread's profiler state to the worker pool (see captureThreadLocalState()), only
+ * jobs submitted while recording show up in the trace. The trace (per-operator cpu time,
+ * input shapes and memory events) is written next to the model as
+ *
+ *      <model_name>.trace.json     --> open in chrome://tracing or https://ui.perfetto.dev
+ *
+ * and the operators with the highest total cpu time are printed.
+ */
+class DeployProfiler {
+public:
+    struct Settings {
+        bool enable{false};
+        int skip_first_n_calls{5};
+        int num_deploy_calls{20};
+        bool record_shapes{true};
+        bool profile_memory{true};
+        int print_top_n_ops{15};
+    };
+
+    explicit DeployProfiler(Settings settings_) : settings(settings_) {}
+
+    // profiles the next calls of a newly installed model
+    void rearm() {
+        if (active) { stop(""); }
+        num_calls_seen = 0;
+        num_calls_profiled = 0;
+        done = false;
+    }
+
+    // called by the DPL thread right before deploy()
+    void beginDeploy() {
+        if (!settings.enable || done || active) { return; }
+        if (num_calls_seen++ < settings.skip_first_n_calls) { return; }
+        start();
+    }
+
+    // called by the DPL thread right after deploy(), writes the trace next to model_path when done
+    void endDeploy(const std::string& model_path) {
+        if (!active) { return; }
+        if (++num_calls_profiled >= std::max(1, settings.num_deploy_calls)) {
+            stop(get_trace_path(model_path));
+            done = true;
+        }
+    }
+
+    [[nodiscard]] bool isActive() const { return active; }
+
+    // called on the DPL thread when submitting a job, apply it with at::ThreadLocalStateGuard
+    // on the thread running the job so that its operators are recorded too
+    [[nodiscard]] std::optional<at::ThreadLocalState> captureThreadLocalState() const {
+        if (!active) { return std::nullopt; }
+        return at::ThreadLocalState();
+    }
+
+    static std::string get_trace_path(const std::string& model_path) {
+        if (model_path.empty()) { return ""; }
+        return std::filesystem::path(model_path).replace_extension(".trace.json").string();
+    }
+
+private:
+    Settings settings;
+    bool active{false};
+    bool done{false};
+    int num_calls_seen{0};
+    int num_calls_profiled{0};
+
+    void start() {
+        using namespace torch::autograd::profiler;
+        try {
+            ProfilerConfig config(torch::profiler::impl::ProfilerState::KINETO, settings.record_shapes,
+                                  settings.profile_memory);
+            std::set<torch::profiler::impl::ActivityType> activities{torch::profiler::impl::ActivityType::CPU};
+            prepareProfiler(config, activities);
+            enableProfiler(config, activities);
+            active = true;
+            std::cout << clr::green << "[DPL] Profiling the next " << settings.num_deploy_calls
+                      << " deploy() calls" << std::endl;
+        } catch (const std::exception& e) {
+            std::cout << clr::yellow << "[DPL] Couldn't start the profiler: " << e.what() << std::endl;
+            done = true;
+        }
+    }
+
+    // an empty trace_path discards the results
+    void stop(const std::string& trace_path) {
+        active = false;
+        std::unique_ptr<torch::autograd::profiler::ProfilerResult> result;
+        try {
+            result = torch::autograd::profiler::disableProfiler();
+        } catch (const std::exception& e) {
+            std::cout << clr::yellow << "[DPL] Couldn't stop the profiler: " << e.what() << std::endl;
+            return;
+        }
+        if (result == nullptr || trace_path.empty()) { return; }
+
+        try {
+            result->save(trace_path);
+            std::cout << clr::green << "[DPL] Profiler trace of " << num_calls_profiled << " deploy() calls written to "
+                      << trace_path << std::endl;
+        } catch (const std::exception& e) {
+            std::cout << clr::yellow << "[DPL] Couldn't write the profiler trace to " << trace_path << ": "
+                      << e.what() << std::endl;
+        }
+        printSummary(*result);
+    }
+
+    void printSummary(const torch::autograd::profiler::ProfilerResult& result) const {
+        if (settings.print_top_n_ops <= 0) { return; }
+
+        struct OpStats {
+            int64_t count{0};
+            int64_t total_us{0};
+            std::string shapes;
+        };
+        std::map<std::string, OpStats> ops;
+        for (const auto& event : result.events()) {
+            if (event.durationUs() <= 0) { continue; }
+            auto& op = ops[event.name()];
+            op.count++;
+            op.total_us += (int64_t) event.durationUs();
+            if (op.shapes.empty() && event.hasShapes()) {
+                std::stringstream shapes;
+                for (const auto& shape : event.shapes()) {
+                    shapes << "[";
+                    for (size_t i = 0; i < shape.size(); i++) { shapes << (i > 0 ? "," : "") << shape[i]; }
+                    shapes << "]";
+                }
+                op.shapes = shapes.str();
+            }
+        }
+
+        std::vector<std::pair<std::string, OpStats>> sorted(ops.begin(), ops.end());
+        std::sort(sorted.begin(), sorted.end(),
+                  [](const auto& a, const auto& b) { return a.second.total_us > b.second.total_us; });
+
+        std::stringstream ss;
+        ss << "Top operators by total cpu time (" << num_calls_profiled << " deploy() calls, nested ops included):";
+        auto num_ops = std::min(sorted.size(), (size_t) settings.print_top_n_ops);
+        for (size_t i = 0; i < num_ops; i++) {
+            const auto& [name, op] = sorted[i];
+            ss << std::endl << "    " << name << " | calls: " << op.count
+               << " | total: " << double(op.total_us) / 1000.0 << " ms"
+               << " | avg: " << double(op.total_us) / double(op.count) / 1000.0 << " ms";
+            if (!op.shapes.empty()) { ss << " | shapes: " << op.shapes; }
+        }
+
+        std::stringstream lines(ss.str());
+        std::string line;
+        while (std::getline(lines, line)) { std::cout << clr::green << "[DPL] " << line << std::endl; }
+    }
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <torch/script.h> // One-stop header.
+#include "CancellationToken.h"
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <utility>
+
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#include <exception>
+
+/*
+ * Coroutine variant of deploy() (requires C++20), see DeploymentThread::deployAsync().
+ *
+ *      DeployTask deployAsync(...) override {
+ *          auto inputs = prepareInputs(new_event_from_host);
+ *          auto output = co_await awaitInference(inputs);     // runs on the worker pool
+ *          decode(output);
+ *          co_return {false, true};
+ *      }
+ *
+ * While the coroutine waits for an inference job, the DPL loop keeps reading gui parameters
+ * and host events (and cancels the call if newer input arrives, see deployment_settings.cancellation).
+ * The coroutine is always resumed on the DPL thread.
+ */
+class DeployTask {
+public:
+    struct promise_type {
+        std::pair<bool, bool> result{false, false};
+        std::exception_ptr exception;
+
+        DeployTask get_return_object() {
+            return DeployTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        // runs synchronously until the first co_await that has to wait
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        // kept alive until the DPL thread has read the result
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_value(std::pair<bool, bool> value) { result = value; }
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+
+    DeployTask(DeployTask&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+    DeployTask& operator=(DeployTask&& other) noexcept {
+        if (this != &other) {
+            if (handle) { handle.destroy(); }
+            handle = std::exchange(other.handle, {});
+        }
+        return *this;
+    }
+    DeployTask(const DeployTask&) = delete;
+    DeployTask& operator=(const DeployTask&) = delete;
+    ~DeployTask() {
+        if (handle) { handle.destroy(); }
+    }
+
+    [[nodiscard]] bool done() const { return !handle || handle.done(); }
+
+    // rethrows the exception thrown by the coroutine (if any)
+    [[nodiscard]] std::pair<bool, bool> getResult() const {
+        if (!handle) { return {false, false}; }
+        if (handle.promise().exception) { std::rethrow_exception(handle.promise().exception); }
+        return handle.promise().result;
+    }
+
+private:
+    explicit DeployTask(std::coroutine_handle<promise_type> handle_) : handle(handle_) {}
+    std::coroutine_handle<promise_type> handle;
+};
+
+// the inference job a suspended DeployTask is waiting for (owned by the DeploymentThread)
+struct PendingInference {
+    std::coroutine_handle<> handle;
+    std::future<torch::jit::IValue>* future{nullptr};
+
+    [[nodiscard]] bool isWaiting() const { return static_cast<bool>(handle); }
+    [[nodiscard]] bool isReady() const {
+        return future != nullptr && future->wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+};
+
+// returned by DeploymentThread::awaitInference(), throws InferenceCancelled on resumption if
+// the deploy call was cancelled while waiting
+class InferenceAwaitable {
+public:
+    InferenceAwaitable(std::future<torch::jit::IValue> future_, PendingInference& pending_,
+                       std::shared_ptr<const CancellationToken> token_) :
+        future(std::move(future_)), pending(pending_), token(std::move(token_)) {}
+
+    bool await_ready() const { return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        pending.handle = handle;
+        pending.future = &future;
+    }
+
+    torch::jit::IValue await_resume() {
+        pending.handle = {};
+        pending.future = nullptr;
+        token->throwIfCancelled();
+        return future.get();
+    }
+
+private:
+    std::future<torch::jit::IValue> future;
+    PendingInference& pending;
+    std::shared_ptr<const CancellationToken> token;
+};
+
+#endif
@@ -6,6 +6,23 @@
 
 DeploymentThread::DeploymentThread(): juce::Thread("BackgroundDPLThread") {
     CustomPresetData = make_unique<CustomPresetDataDictionary>();
+    pending_host_events.reserve(queue_settings::NMP2DPL_que_size);
+
+    if (deployment_settings::ExecutionContext::tensor_arena) {
+        tensorArena = std::make_unique<TensorArena>(
+            (size_t) (deployment_settings::ExecutionContext::arena_size_mb * 1024 * 1024));
+    }
+
+    if (deployment_settings::InferenceGovernor::enable) {
+        namespace governor_settings = deployment_settings::InferenceGovernor;
+        auto intra_op_threads = deployment_settings::TorchThreading::intra_op_threads;
+        auto& governor = InferenceGovernor::instance();
+        governor.configure({governor_settings::max_concurrent_inferences, governor_settings::cpu_budget_fraction,
+                            governor_settings::window_ms,
+                            intra_op_threads > 0 ? intra_op_threads : (int) std::thread::hardware_concurrency()});
+        governor_instance_id = governor.registerInstance("DeploymentThread");
+        inferenceWaitTimes = governor.getWaitTimes(governor_instance_id);
+    }
 }
 
 void DeploymentThread::startThreadUsingProvidedResources(
@@ -29,7 +46,7 @@ void DeploymentThread::startThreadUsingProvidedResources(
 
     // Start the thread. This function internally calls run() method. DO NOT CALL run() DIRECTLY.
     // ---------------------------------------------------------------------------------------------
-    startThread();
+    startThread(get_juce_thread_priority(get_thread_scheduling_settings("DeploymentThread")));
 }
 
 void DeploymentThread::run() {
@@ -52,16 +69,53 @@ void DeploymentThread::run() {
 
     std::optional<EventFromHost> new_event_from_DAW {};
     std::optional<MidiFileEvent> new_midi_event_dropped_manually {};
-    bool shouldSendNewPlaybackPolicy;
-    bool shouldSendNewPlaybackSequence;
     bool midiFileDroppedOnVisualizer;
     int cyclesToIgnoreTriggerButtons = -1; // when a preset is loaded we disable the trigger buttons for two iterations two ensure the preset doesn't trigger these buttons
     int cnt{0};
 
     cout << "Deployment Thread is running..." << endl;
+
+    // has to happen on this thread before the first inference
+    configure_torch_threading();
+    // scheduling policy, nice value and affinity (inherited by the torch threads spawned from here on Linux)
+    apply_thread_scheduling(get_thread_scheduling_settings("DeploymentThread"), "[DPL]");
+
+    if (deployment_settings::LogitsSampler::benchmark_on_start) {
+        for (auto params : {SamplingParams{1.0f, 0, 1.0f}, SamplingParams{0.9f, 40, 0.95f, 1.2f}}) {
+            benchmark_logits_sampler(deployment_settings::LogitsSampler::benchmark_vocab_size,
+                                     deployment_settings::LogitsSampler::benchmark_iterations, params);
+        }
+    }
+
     while (!bExit) {
 
         if (readyToStop) { break; } // check if thread is ready to be stopped
+
+#if defined(__cpp_impl_coroutine)
+        // a deployAsync() call is waiting for inference, keep consuming input until it resumes and finishes
+        if (pendingDeployTask.has_value() && serviceAsyncDeploy()) {
+            // files dropped meanwhile are deployed once the call has finished, but they already
+            // change the context of the upcoming bar
+            if (GUI2DPL_DroppedMidiFile_Que_ptr->getNumReady() > 0) {
+                dropped_midi_file = GUI2DPL_DroppedMidiFile_Que_ptr->getLatestOnly();
+                speculativeBarScheduler.invalidate();
+            }
+            if (hasUserDroppedFilesOnVisualizers()) { speculativeBarScheduler.invalidate(); }
+
+            if (pendingInference.future != nullptr) {
+                pendingInference.future->wait_for(
+                    std::chrono::milliseconds(deployment_settings::AsyncDeploy::poll_interval_ms));
+            } else {
+                sleep(deployment_settings::AsyncDeploy::poll_interval_ms);
+            }
+            bExit = threadShouldExit();
+            continue;
+        }
+#endif
+
+        // safe point: no deploy() call in progress, so a model loaded in the background can be swapped in
+        swapInReadyModel();
+
         if (APVM2DPL_Parameters_Que_ptr->getNumReady() > 0) {
             // print updated values for debugging
             gui_params = APVM2DPL_Parameters_Que_ptr
@@ -72,12 +126,13 @@ void DeploymentThread::run() {
                 showMessage(gui_params.getDescriptionOfUpdatedParams());
             }
 
-        } else {
+        } else if (!gui_params_received_during_deploy) {
             gui_params.setChanged(false); // no change in parameters since last check
         }
+        gui_params_received_during_deploy = false;
 
-        if (NMP2DPL_Event_Que_ptr->getNumReady() > 0) {
-            new_event_from_DAW = NMP2DPL_Event_Que_ptr->pop();      // get the next available event
+        new_event_from_DAW = popNextHostEvent();      // get the next available event
+        if (new_event_from_DAW.has_value()) {
 
             events_received_count++;
 
@@ -85,8 +140,6 @@ void DeploymentThread::run() {
                 DisplayEvent(*new_event_from_DAW, false, events_received_count);   // display the event
             }
 
-        } else {
-            new_event_from_DAW = std::nullopt;
         }
 
         // check if a new midi file dropped on the visualizer
@@ -124,6 +177,17 @@ void DeploymentThread::run() {
         if (new_event_from_DAW.has_value() || gui_params.changed() || newPresAvail || midiFileDroppedOnVisualizer || audioFileDroppedOnVisualizer) {
             new_midi_event_dropped_manually = std::nullopt;
 
+            // any new input (other than the playhead simply moving forward) changes the context
+            // used for generating the upcoming bar
+            auto context_changed = gui_params.changed() || newPresAvail || midiFileDroppedOnVisualizer ||
+                                   audioFileDroppedOnVisualizer;
+            if (new_event_from_DAW.has_value()) {
+                context_changed = context_changed || new_event_from_DAW->isMidiMessageEvent() ||
+                                  new_event_from_DAW->isFirstBufferEvent() ||
+                                  new_event_from_DAW->isPlaybackStoppedEvent();
+            }
+            if (context_changed) { speculativeBarScheduler.invalidate(); }
+
             if (newPresAvail) {
                 cyclesToIgnoreTriggerButtons = 2;
             }
@@ -133,28 +197,50 @@ void DeploymentThread::run() {
             }
 
 
-            auto status = deploy(
-                new_midi_event_dropped_manually, new_event_from_DAW,
-                gui_params.changed(), newPresAvail,
-                midiFileDroppedOnVisualizer,
-                audioFileDroppedOnVisualizer);
-            gui_params.setChanged(false);
+            updateModelState(new_event_from_DAW, newPresAvail);
+            if (new_event_from_DAW.has_value() && (!new_event_from_DAW->isNewBufferEvent() ||
+                                                   deployment_settings::EventHistory::record_new_buffer_events)) {
+                eventHistory.push(*new_event_from_DAW);
+            }
 
-            shouldSendNewPlaybackPolicy = status.first;
-            shouldSendNewPlaybackSequence = status.second;
-            // push to next thread if a new input is provided
-            if (shouldSendNewPlaybackPolicy) {
-                // send to the main thread (NMP)
-                if (playbackPolicy.IsReadyForTransmission()) {
-                    DPL2NMP_GenerationEvent_Que_ptr->push(GenerationEvent(playbackPolicy));
-                }
+            // generations triggered by the host should be ready by the start of the next bar
+            deploy_deadline = new_event_from_DAW.has_value() ?
+                              DeployDeadline::nextBarAfter(*new_event_from_DAW) : std::nullopt;
+            inference_deadline = std::nullopt;
+            if (deploy_deadline.has_value() && deploy_deadline->sample_rate > 0) {
+                auto seconds_left = double(deploy_deadline->time_in_samples - new_event_from_DAW->Time().inSamples()) /
+                                    deploy_deadline->sample_rate;
+                inference_deadline = InferenceGovernor::clock::now() +
+                                     std::chrono::microseconds(int64_t(seconds_left * 1e6));
             }
 
-            if (shouldSendNewPlaybackSequence) {
-                // send to the main thread (NMP)
-                DPL2NMP_GenerationEvent_Que_ptr->push(GenerationEvent(playbackSequence));
-                cnt++;
+            beginDeployCall();
+            std::optional<std::pair<bool, bool>> status;
+#if defined(__cpp_impl_coroutine)
+            if (deployment_settings::AsyncDeploy::enable) {
+                status = startAsyncDeploy(
+                    new_midi_event_dropped_manually, new_event_from_DAW,
+                    gui_params.changed(), newPresAvail,
+                    midiFileDroppedOnVisualizer,
+                    audioFileDroppedOnVisualizer);
+            } else
+#endif
+            {
+                status = std::pair<bool, bool>{false, false};
+                try {
+                    status = deploy(
+                        new_midi_event_dropped_manually, new_event_from_DAW,
+                        gui_params.changed(), newPresAvail,
+                        midiFileDroppedOnVisualizer,
+                        audioFileDroppedOnVisualizer);
+                } catch (const InferenceCancelled&) {
+                    // forward() was called after the token was tripped, handled in finishDeployCall()
+                }
             }
+            gui_params.setChanged(false);
+
+            // otherwise the coroutine is still waiting for inference, finished by serviceAsyncDeploy()
+            if (status.has_value()) { finishDeployCall(*status); }
 
         }
 
@@ -164,8 +250,13 @@ void DeploymentThread::run() {
         }
 
         // check if notes received from a manually dropped midi file
-        if (GUI2DPL_DroppedMidiFile_Que_ptr->getNumReady() > 0){
-            auto midifile = GUI2DPL_DroppedMidiFile_Que_ptr->getLatestOnly();
+        if (GUI2DPL_DroppedMidiFile_Que_ptr->getNumReady() > 0) {
+            dropped_midi_file = GUI2DPL_DroppedMidiFile_Que_ptr->getLatestOnly();
+        }
+        // deploy() can't run while a deployAsync() call started above is still pending
+        if (dropped_midi_file.has_value() && !isAsyncDeployPending()) {
+            auto midifile = std::move(*dropped_midi_file);
+            dropped_midi_file.reset();
 
             if (midifile.getNumTracks() > 0) {
                 auto track = midifile.getTrack(0);
@@ -180,26 +271,22 @@ void DeploymentThread::run() {
 
                     auto isFirst = (i == 0);
                     auto isLast = (i == track->getNumEvents() - 1);
+                    speculativeBarScheduler.invalidate();
                     new_midi_event_dropped_manually = MidiFileEvent(msg_, isFirst, isLast);
                     new_event_from_DAW = std::nullopt;
-                    auto status =  deploy(new_midi_event_dropped_manually, new_event_from_DAW, false, false, false, false);
-                    shouldSendNewPlaybackPolicy = status.first;
-                    shouldSendNewPlaybackSequence = status.second;
-
-                    // push to next thread if a new input is provided
-                    if (shouldSendNewPlaybackPolicy) {
-                        // send to the main thread (NMP)
-                        if (playbackPolicy.IsReadyForTransmission()) {
-                            DPL2NMP_GenerationEvent_Que_ptr->push(GenerationEvent(playbackPolicy));
-                        }
-                    }
 
-                    if (shouldSendNewPlaybackSequence) {
-                        // send to the main thread (NMP)
-                        DPL2NMP_GenerationEvent_Que_ptr->push(GenerationEvent(playbackSequence));
-                        cnt++;
-                    }
+                    // not tied to the host's playhead, so there is no deadline to meet
+                    deploy_deadline = std::nullopt;
+                    inference_deadline = std::nullopt;
 
+                    beginDeployCall();
+                    std::pair<bool, bool> status{false, false};
+                    try {
+                        status = deploy(new_midi_event_dropped_manually, new_event_from_DAW, false, false, false, false);
+                    } catch (const InferenceCancelled&) {
+                        // forward() was called after the token was tripped, handled in finishDeployCall()
+                    }
+                    finishDeployCall(status);
                 }
             }
         }
@@ -217,19 +304,501 @@ void DeploymentThread::run() {
             last_event = *new_event_from_DAW;
         }
 
+        // start generating the next bar ahead of time if it is close enough
+        updateSpeculativeGeneration();
+
         // check if thread is still running
         bExit = threadShouldExit();
 
-        if (!new_event_from_DAW.has_value() && !gui_params.changed()) {
+        if (!new_event_from_DAW.has_value() && !gui_params.changed() && pending_host_events.empty()) {
             // wait for a few ms to avoid burning the CPU if new data is not available
             sleep((int)thread_configurations::SingleMidiThread::waitTimeBtnIters);
         }
     }
 
+    // the thread-local inference context has to be left on this thread
+#if defined(__cpp_impl_coroutine)
+    pendingDeployTask.reset();
+    pendingInference = {};
+#endif
+    deployContext.reset();
+}
+
+bool DeploymentThread::hasUserDroppedFilesOnVisualizers()
+{
+    if (midiVisualizersData != nullptr &&
+        !midiVisualizersData->get_visualizer_ids_with_user_dropped_new_sequences().empty()) {
+        return true;
+    }
+    return audioVisualizersData != nullptr &&
+           !audioVisualizersData->get_visualizer_ids_with_user_dropped_new_audio().empty();
+}
+
+bool DeploymentThread::isAsyncDeployPending() const
+{
+#if defined(__cpp_impl_coroutine)
+    return pendingDeployTask.has_value();
+#else
+    return false;
+#endif
+}
+
+void DeploymentThread::drainHostEventQueue()
+{
+    // move everything the NMP thread has queued so far into the local buffer
+    // never more than the lock-free queue itself can hold, so the backlog stays bounded even
+    // without coalescing
+    auto num_free = (int) queue_settings::NMP2DPL_que_size - (int) pending_host_events.size();
+    auto num_ready = std::min(NMP2DPL_Event_Que_ptr->getNumReady(), num_free);
+    for (int i = 0; i < num_ready; i++) {
+        pending_host_events.push_back(NMP2DPL_Event_Que_ptr->pop());
+    }
+}
+
+int DeploymentThread::coalesceStaleHostEvents()
+{
+    // Only the most recent buffer and time-shift events are relevant once the thread is behind,
+    // the earlier ones describe playhead positions that have already passed. Every other
+    // event (notes, cc, new bar, first buffer, playback stopped) is kept in its original order.
+    if (pending_host_events.size() < 2) { return 0; }
+
+    auto num_events = pending_host_events.size();
+    auto last_buffer_event = num_events;
+    auto last_time_shift_event = num_events;
+    for (size_t i = 0; i < num_events; i++) {
+        if (pending_host_events[i].isNewBufferEvent()) { last_buffer_event = i; }
+        else if (pending_host_events[i].isNewTimeShiftEvent()) { last_time_shift_event = i; }
+    }
+
+    // compacted in place (stable), no allocation
+    size_t num_kept = 0;
+    for (size_t i = 0; i < num_events; i++) {
+        const auto& event = pending_host_events[i];
+        auto is_stale = (event.isNewBufferEvent() && i != last_buffer_event) ||
+                        (event.isNewTimeShiftEvent() && i != last_time_shift_event);
+        if (is_stale) { continue; }
+        if (num_kept != i) { pending_host_events[num_kept] = std::move(pending_host_events[i]); }
+        num_kept++;
+    }
+
+    pending_host_events.erase(pending_host_events.begin() + (std::ptrdiff_t) num_kept, pending_host_events.end());
+    return (int) (num_events - num_kept);
+}
+
+bool DeploymentThread::hasHigherPriorityInputQueued()
+{
+    using namespace deployment_settings::Cancellation;
+    auto num_new_gui_params = APVM2DPL_Parameters_Que_ptr->getNumReady() + num_gui_params_popped_during_deploy -
+                              num_gui_params_pending_at_deploy_start;
+    if (cancel_on_gui_changes && num_new_gui_params > 0) { return true; }
+
+    // events are only appended while deploy() runs, so everything after the first
+    // num_host_events_pending_at_deploy_start events arrived after the call started
+    drainHostEventQueue();
+    auto first_new_event = std::min(num_host_events_pending_at_deploy_start, pending_host_events.size());
+    for (auto i = first_new_event; i < pending_host_events.size(); i++) {
+        const auto& event = pending_host_events[i];
+        if (cancel_on_note_events && event.isMidiMessageEvent()) { return true; }
+        if (cancel_on_playback_stop && (event.isPlaybackStoppedEvent() || event.isFirstBufferEvent())) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool DeploymentThread::isDeployCancelled()
+{
+    if (!deployment_settings::Cancellation::enable || !deploy_in_progress) { return false; }
+    if (deployCancellationToken->isCancelled()) { return true; }
+
+    // the queues (and pending_host_events) are only touched by the DPL thread, worker threads
+    // just see the token once the DPL thread has tripped it
+    if (juce::Thread::getCurrentThread() == this && hasHigherPriorityInputQueued()) {
+        deployCancellationToken->cancel();
+        cancelled_deploys_count++;
+    }
+    return deployCancellationToken->isCancelled();
+}
+
+void DeploymentThread::throwIfDeployCancelled()
+{
+    if (isDeployCancelled()) { throw InferenceCancelled(); }
+}
+
+std::optional<torch::jit::IValue> DeploymentThread::waitForInference(std::future<torch::jit::IValue>& future)
+{
+    return wait_for_result(future, [this]() { return isDeployCancelled(); });
+}
+
+void DeploymentThread::enterInferenceContext()
+{
+    num_deploy_contexts++;
+    deployContext.emplace(deployment_settings::ExecutionContext::inference_mode, tensorArena.get());
+}
+
+void DeploymentThread::exitInferenceContext()
+{
+    deployContext.reset();
+    printTensorArenaStats();
+}
+
+void DeploymentThread::beginDeployCall()
+{
+    deploy_call_timer.registerStartTime();
+    deployCancellationToken->reset();
+    drainHostEventQueue();
+    num_host_events_pending_at_deploy_start = pending_host_events.size();
+    num_gui_params_pending_at_deploy_start = APVM2DPL_Parameters_Que_ptr->getNumReady();
+    num_gui_params_popped_during_deploy = 0;
+    deploy_in_progress = true;
+    deployProfiler.beginDeploy();
+    enterInferenceContext();
+}
+
+void DeploymentThread::finishDeployCall(std::pair<bool, bool> status)
+{
+    exitInferenceContext();
+    deployProfiler.endDeploy(installed_model_path);
+    deploy_in_progress = false;
+
+    // the generated sequence is based on outdated input, the newer input is deployed next
+    auto was_cancelled = deployCancellationToken->isCancelled();
+    if (was_cancelled && deployment_settings::Cancellation::print_cancellations) {
+        std::cout << clr::green << "[DPL] Deploy cancelled, newer input available (total: "
+                  << cancelled_deploys_count << ")" << std::endl;
+    }
+
+    auto shouldSendNewPlaybackPolicy = status.first;
+    auto shouldSendNewPlaybackSequence = status.second && !was_cancelled && checkDeployDeadline();
+    {
+        auto push_timer = timeStage(DeployStage::Push);
+        // push to next thread if a new input is provided
+        if (shouldSendNewPlaybackPolicy) {
+            // send to the main thread (NMP)
+            if (playbackPolicy.IsReadyForTransmission()) {
+                DPL2NMP_GenerationEvent_Que_ptr->push(GenerationEvent(playbackPolicy));
+            }
+        }
+
+        if (shouldSendNewPlaybackSequence) {
+            // send to the main thread (NMP)
+            DPL2NMP_GenerationEvent_Que_ptr->push(GenerationEvent(playbackSequence));
+        }
+    }
+    deploy_call_timer.registerEndTime();
+    recordDeployLatency(deploy_call_timer.getDurationInNanoseconds());
+}
+
+#if defined(__cpp_impl_coroutine)
+DeployTask DeploymentThread::deployAsync(
+    std::optional<MidiFileEvent> new_midi_event_dragdrop,
+    std::optional<EventFromHost> new_event_from_host,
+    bool did_any_gui_params_change,
+    bool new_preset_loaded_since_last_call,
+    bool new_midi_file_dropped_on_visualizers,
+    bool new_audio_file_dropped_on_visualizers)
+{
+    co_return deploy(new_midi_event_dragdrop, new_event_from_host, did_any_gui_params_change,
+                     new_preset_loaded_since_last_call, new_midi_file_dropped_on_visualizers,
+                     new_audio_file_dropped_on_visualizers);
+}
+
+InferenceAwaitable DeploymentThread::awaitInference(const std::vector<torch::jit::IValue>& inputs)
+{
+    auto futures = submitInferenceJobs({inputs});
+    return {std::move(futures.front()), pendingInference, deployCancellationToken};
+}
+
+InferenceAwaitable DeploymentThread::awaitInference(InferenceWorkerPool::Job job)
+{
+    // same as forward(): governed, cancellable and float32 outputs for reduced precision models.
+    // The inputs are created inside the job, so casting them to model_floating_dtype is up to the job
+    auto dtype = model_floating_dtype;
+    auto future = submitInferenceJob([job = std::move(job), dtype](torch::jit::script::Module& m) {
+        auto output = job(m);
+        return dtype == torch::kFloat32 ? output : cast_floating_tensors(output, torch::kFloat32);
+    });
+    return {std::move(future), pendingInference, deployCancellationToken};
+}
+
+std::optional<std::pair<bool, bool>> DeploymentThread::startAsyncDeploy(
+    std::optional<MidiFileEvent>& new_midi_event_dragdrop, std::optional<EventFromHost>& new_event_from_host,
+    bool did_any_gui_params_change, bool new_preset_loaded_since_last_call,
+    bool new_midi_file_dropped_on_visualizers, bool new_audio_file_dropped_on_visualizers)
+{
+    // runs synchronously until the first co_await that has to wait for a worker
+    pendingDeployTask.emplace(deployAsync(new_midi_event_dragdrop, new_event_from_host, did_any_gui_params_change,
+                                          new_preset_loaded_since_last_call, new_midi_file_dropped_on_visualizers,
+                                          new_audio_file_dropped_on_visualizers));
+    if (!pendingDeployTask->done()) { return std::nullopt; }
+
+    std::pair<bool, bool> status{false, false};
+    try {
+        status = pendingDeployTask->getResult();
+    } catch (const InferenceCancelled&) {
+        // handled in finishDeployCall()
+    }
+    pendingDeployTask.reset();
+    return status;
+}
+
+bool DeploymentThread::serviceAsyncDeploy()
+{
+    // keep consuming input while the coroutine waits, the latest gui params go to the next call
+    if (APVM2DPL_Parameters_Que_ptr->getNumReady() > 0) {
+        gui_params = APVM2DPL_Parameters_Que_ptr->pop();
+        gui_params_received_during_deploy = true;
+        num_gui_params_popped_during_deploy++;
+    }
+    drainHostEventQueue();
+
+    // resumed right away when cancelled (the result of the job is discarded)
+    auto cancelled = isDeployCancelled();
+    if (pendingInference.isWaiting() && (cancelled || pendingInference.isReady())) {
+        auto handle = std::exchange(pendingInference.handle, {});
+        handle.resume();
+    }
+    if (!pendingDeployTask->done()) { return true; }
+
+    std::pair<bool, bool> status{false, false};
+    try {
+        status = pendingDeployTask->getResult();
+    } catch (const InferenceCancelled&) {
+        // handled in finishDeployCall()
+    }
+    pendingDeployTask.reset();
+    finishDeployCall(status);
+    return false;
+}
+#endif
+
+void DeploymentThread::printTensorArenaStats()
+{
+    auto print_every = deployment_settings::ExecutionContext::print_arena_stats_every_n_calls;
+    if (tensorArena != nullptr && print_every > 0 && num_deploy_contexts % print_every == 0) {
+        std::cout << clr::green << "[DPL] " << tensorArena->getDescription() << std::endl;
+    }
+}
+
+InferenceGovernor::Slot DeploymentThread::acquireInferenceSlot()
+{
+    if (governor_instance_id < 0) { return {}; }
+    auto slot = InferenceGovernor::instance().acquire(governor_instance_id, inference_deadline,
+                                                      [this]() { return isDeployCancelled(); });
+    if (!slot.has_value()) { throw InferenceCancelled(); }
+    return std::move(*slot);
+}
+
+InferenceWorkerPool::Job DeploymentThread::governInferenceJob(InferenceWorkerPool::Job job)
+{
+    // jobs submitted outside of deploy() (speculative generation) have no deadline and aren't cancelled
+    std::shared_ptr<CancellationToken> token = deploy_in_progress ? deployCancellationToken : nullptr;
+    auto deadline = deploy_in_progress ? inference_deadline : std::nullopt;
+    auto instance_id = governor_instance_id;
+    auto profiler_state = deployProfiler.captureThreadLocalState();
+
+    return [job = std::move(job), token, deadline, instance_id, profiler_state](torch::jit::script::Module& m) {
+        // queued jobs of a cancelled deploy() call don't need to run anymore
+        if (token != nullptr) { token->throwIfCancelled(); }
+
+        // record the job in the DeployProfiler trace if it was submitted while profiling
+        std::optional<at::ThreadLocalStateGuard> profiler_guard;
+        if (profiler_state.has_value()) { profiler_guard.emplace(*profiler_state); }
+
+        // same mode as deploy(), so that the job can update the tensors created there in place
+        c10::InferenceMode inference_mode(deployment_settings::ExecutionContext::inference_mode);
+
+        std::optional<InferenceGovernor::Slot> slot;
+        if (instance_id >= 0) {
+            std::function<bool()> should_cancel;
+            if (token != nullptr) { should_cancel = [token]() { return token->isCancelled(); }; }
+            slot = InferenceGovernor::instance().acquire(instance_id, deadline, should_cancel);
+            if (!slot.has_value()) { throw InferenceCancelled(); }
+        }
+
+        at::NoGradGuard no_grad;
+        return job(m);
+    };
+}
+
+std::optional<EventFromHost> DeploymentThread::popNextHostEvent()
+{
+    drainHostEventQueue();
+
+    if (deployment_settings::coalesce_stale_host_events) {
+        auto num_merged = coalesceStaleHostEvents();
+        if (num_merged > 0) {
+            coalesced_events_count += num_merged;
+            if (debugging_settings::DeploymentThread::print_coalesced_events) {
+                std::cout << clr::green << "[DPL] Coalesced " << num_merged
+                          << " stale host events (total: " << coalesced_events_count << ")"
+                          << std::endl;
+            }
+        }
+    }
+
+    if (pending_host_events.empty()) { return std::nullopt; }
+
+    auto next_event = std::move(pending_host_events.front());
+    pending_host_events.erase(pending_host_events.begin());
+    return next_event;
+}
+
+void DeploymentThread::updateSpeculativeGeneration()
+{
+    using namespace deployment_settings::SpeculativeGeneration;
+    // without a pool the job would run inline and block the DPL thread until the result is ready
+    if (!enable || !isModelLoaded || realtimePlaybackInfo == nullptr || inferenceWorkerPool == nullptr) { return; }
+    // speculative jobs need the TorchScript module
+    if (backend == nullptr || backend->getModule() == nullptr) { return; }
+
+    auto now = SpeculativeBarScheduler::clock::now();
+    if (!speculativeBarScheduler.shouldReadPlayhead(now)) { return; }
+    auto playhead = realtimePlaybackInfo->get();
+    speculativeBarScheduler.setPlayhead(playhead, now);
+
+    auto upcoming_bar = speculativeBarScheduler.getBarToSpeculate(playhead);
+    if (!upcoming_bar.has_value()) { return; }
+
+    std::optional<InferenceWorkerPool::Job> job;
+    {
+        c10::InferenceMode inference_mode(deployment_settings::ExecutionContext::inference_mode);
+        job = prepareSpeculativeBarJob(*upcoming_bar);
+    }
+    if (job.has_value()) {
+        speculativeBarScheduler.launch(*upcoming_bar, submitInferenceJob(std::move(*job)));
+    }
+}
+
+std::optional<torch::jit::IValue> DeploymentThread::takeSpeculativeResult(double bar_start_ppq)
+{
+    using namespace deployment_settings::SpeculativeGeneration;
+    auto result = speculativeBarScheduler.take(bar_start_ppq);
+
+    auto num_bars = speculativeBarScheduler.getNumHits() + speculativeBarScheduler.getNumMisses();
+    if (print_stats_every_n_bars > 0 && num_bars % print_stats_every_n_bars == 0) {
+        std::cout << clr::green << "[DPL] " << speculativeBarScheduler.getDescription() << std::endl;
+    }
+
+    return result;
+}
+
+void DeploymentThread::updateModelState(const std::optional<EventFromHost>& new_event_from_host,
+                                        bool new_preset_loaded)
+{
+    using namespace deployment_settings::ModelState;
+
+    if (new_preset_loaded && reset_on_preset_load) { resetModelState("preset loaded"); }
+    if (!new_event_from_host.has_value()) { return; }
+
+    auto reason = modelState.observe(*new_event_from_host);
+    if (!reason.has_value()) { return; }
+    if (new_event_from_host->isPlaybackStoppedEvent() ? reset_on_playback_stop : reset_on_backward_jump) {
+        resetModelState(*reason);
+    }
+}
+
+void DeploymentThread::resetModelState(const std::string& reason)
+{
+    if (modelState.isEmpty()) { return; }
+    modelState.reset(reason);
+    if (deployment_settings::ModelState::print_resets) {
+        std::cout << clr::green << "[DPL] " << modelState.getDescription() << std::endl;
+    }
+}
+
+void DeploymentThread::setDeployDeadline(std::optional<int64_t> time_in_samples)
+{
+    if (!time_in_samples.has_value()) {
+        deploy_deadline = std::nullopt;
+    } else if (deploy_deadline.has_value()) {
+        // keep the bar info of the default deadline so that re-anchoring still works
+        deploy_deadline->time_in_samples = *time_in_samples;
+    } else {
+        deploy_deadline = DeployDeadline::atSample(*time_in_samples);
+    }
+}
+
+bool DeploymentThread::checkDeployDeadline()
+{
+    if (!deploy_deadline.has_value() || realtimePlaybackInfo == nullptr) { return true; }
+
+    auto num_missed_before = deadlineTracker.getTotalNumMissed();
+    auto should_send = deadlineTracker.evaluate(
+        installed_model_path, *deploy_deadline, realtimePlaybackInfo->get(), playbackPolicy, playbackSequence);
+
+    auto num_missed = deadlineTracker.getTotalNumMissed();
+    auto print_every = deployment_settings::Deadlines::print_stats_every_n_misses;
+    if (print_every > 0 && num_missed != num_missed_before && num_missed % print_every == 0) {
+        std::cout << clr::green << "[DPL] " << deadlineTracker.getDescription() << std::endl;
+    }
+
+    deploy_deadline = std::nullopt;
+    return should_send;
+}
+
+void DeploymentThread::recordDeployLatency(int64_t deploy_duration_ns)
+{
+    deployLatencyProfiler.record(DeployStage::Total, deploy_duration_ns);
+    num_timed_deploy_calls++;
+
+    if (debugging_settings::DeploymentThread::print_deploy_method_time) {
+        std::cout << clr::green << "[DPL] Deploy method took " << double(deploy_duration_ns) / 1e6 << " ms"
+                  << std::endl;
+    }
+
+    auto print_every = debugging_settings::DeploymentThread::print_deploy_latency_every_n_calls;
+    if (print_every > 0 && num_timed_deploy_calls % print_every == 0) {
+        std::cout << clr::green << "[DPL] " << deployLatencyProfiler.getDescription() << std::endl;
+    }
+}
+
+std::optional<InferenceCache::Entry> DeploymentThread::getCachedInference(const InferenceCache::Key& key)
+{
+    using namespace deployment_settings::InferenceCache;
+    auto entry = inferenceCache.get(key);
+
+    if (print_stats_every_n_lookups > 0 && inferenceCache.getNumLookups() % print_stats_every_n_lookups == 0) {
+        std::cout << clr::green << "[DPL] " << inferenceCache.getDescription() << std::endl;
+    }
+
+    return entry;
 }
 
 void DeploymentThread::prepareToStop()
 {
+    // waits for a load in progress to finish (see ~AsyncModelLoader)
+    if (asyncModelLoader != nullptr) { asyncModelLoader->stopThread(-1); }
+
+    if (deployment_settings::SpeculativeGeneration::enable) {
+        std::cout << clr::green << "[DPL] " << speculativeBarScheduler.getDescription() << std::endl;
+    }
+    if (inferenceCache.getNumLookups() > 0) {
+        std::cout << clr::green << "[DPL] " << inferenceCache.getDescription() << std::endl;
+    }
+    if (workspace.getMemoryUsageInBytes() > 0) {
+        std::cout << clr::green << "[DPL] " << installed_model_path << " -- " << workspace.getDescription()
+                  << std::endl;
+    }
+    if (!deadlineTracker.getStats().empty()) {
+        std::cout << clr::green << "[DPL] " << deadlineTracker.getDescription() << std::endl;
+    }
+    if (deployLatencyProfiler.get(DeployStage::Total).getCount() > 0) {
+        std::cout << clr::green << "[DPL] " << deployLatencyProfiler.getDescription() << std::endl;
+    }
+    if (cancelled_deploys_count > 0) {
+        std::cout << clr::green << "[DPL] Cancelled deploy calls: " << cancelled_deploys_count << std::endl;
+    }
+    if (tensorArena != nullptr) {
+        std::cout << clr::green << "[DPL] " << tensorArena->getDescription() << std::endl;
+    }
+    if (governor_instance_id >= 0) {
+        std::cout << clr::green << "[DPL] " << InferenceGovernor::instance().getDescription() << std::endl;
+    }
+    if (deployment_settings::ModelSharing::share_across_instances) {
+        std::cout << clr::green << "[DPL] " << SharedModelRegistry::instance().getDescription() << std::endl;
+    }
+
     // Need to wait enough to ensure the run() method is over before killing thread
     this->stopThread(100 * thread_configurations::SingleMidiThread::waitTimeBtnIters);
 
@@ -241,6 +810,7 @@ DeploymentThread::~DeploymentThread()
     if (!readyToStop) {
         prepareToStop();
     }
+    if (governor_instance_id >= 0) { InferenceGovernor::instance().unregisterInstance(governor_instance_id); }
 }
 
 void DeploymentThread::DisplayEvent(const EventFromHost& event,
@@ -288,6 +858,7 @@ bool DeploymentThread::load(const std::string& model_name_)
 
     // If already tried the path, don't try again
     if (model_path == model_path_) {
+        requested_model_path = model_path_;
         if (isModelLoaded) {
             return true;
         } else {
@@ -295,17 +866,50 @@ bool DeploymentThread::load(const std::string& model_name_)
         }
     }
 
+    // model_path is only committed in swapInReadyModel(), the current model (if any) keeps
+    // serving until then. A failed load isn't retried (unless the file changes, see
+    // reload_on_file_change)
+    if (deployment_settings::ModelHotSwap::load_asynchronously &&
+        get_model_load_settings(model_name_).backend != "native") {
+        requested_model_path = model_path_;
+        if (asyncModelLoader == nullptr) {
+            asyncModelLoader = std::make_unique<AsyncModelLoader>(
+                deployment_settings::ModelHotSwap::reload_on_file_change,
+                deployment_settings::ModelHotSwap::file_watch_interval_ms);
+        }
+        if (!asyncModelLoader->getRequestState(model_path_).has_value()) {
+            cout << "Loading model in the background: " << model_path_ << endl;
+            asyncModelLoader->requestLoad(model_name_, model_path_);
+        }
+        return false;
+    }
+
     model_path = model_path_;
+    requested_model_path = model_path_;
+
+    // small models can run on the native engine without loading the TorchScript file
+    if (get_model_load_settings(model_name_).backend == "native" && loadNativeBackend(model_name_)) {
+        return true;
+    }
 
     ifstream myFile;
     myFile.open(model_path);
     if (myFile.is_open()) {
         cout << "Model file found at: " + model_path << " -- Trying to load model..." << endl;
         myFile.close();
-        model = torch::jit::load(model_path, torch::kCPU);
-        model.eval();
-        isModelLoaded = true;
-        myFile.close();
+
+        // freezing, optimization and warm-up (if requested) all happen before the model is marked as loaded
+        if (deployment_settings::ModelSharing::share_across_instances) {
+            auto shared = SharedModelRegistry::instance().acquire(model_path, model_name_);
+            installModel(shared->module, model_path, shared->floating_dtype);
+            sharedModel = shared;
+            return true;
+        }
+        auto floating_dtype = torch::kFloat32;
+        auto new_model = load_and_prepare_model(model_path, get_model_load_settings(model_name_), &floating_dtype);
+        benchmark_torch_thread_counts_if_enabled(new_model, model_path, model_name_, floating_dtype);
+        installModel(new_model, model_path, floating_dtype);
+        sharedModel.reset();
         return true;
     } else {
         cout << "Model file not found at: " + model_path << endl;
@@ -314,6 +918,231 @@ bool DeploymentThread::load(const std::string& model_name_)
     }
 }
 
+std::optional<AsyncModelLoader::RequestState> DeploymentThread::getModelLoadState(const std::string& model_name_)
+{
+    if (asyncModelLoader == nullptr) { return std::nullopt; }
+    return asyncModelLoader->getRequestState(stripQuotes(std::string(MDL_path::default_model_path)) +
+                                             std::string(MDL_path::path_separator) + model_name_);
+}
+
+bool DeploymentThread::loadNativeBackend(const std::string& model_name_)
+{
+    auto spec_path = get_native_spec_path(model_path);
+    if (!std::filesystem::exists(spec_path)) {
+        cout << "Native engine spec not found at " << spec_path << " -- using TorchScript" << endl;
+        return false;
+    }
+
+    std::shared_ptr<NativeBackend> native_backend;
+    try {
+        native_backend = std::make_shared<NativeBackend>(spec_path);
+    } catch (const std::exception& e) {
+        cout << "Failed to load the native engine: " << e.what() << " -- using TorchScript" << endl;
+        return false;
+    }
+    cout << native_backend->getDescription() << endl;
+
+    auto settings = get_model_load_settings(model_name_);
+    if (settings.compare_backends && std::filesystem::exists(model_path)) {
+        auto inputs = make_warmup_inputs(model_path, settings);
+        if (inputs.empty()) {
+            cout << "No warm-up inputs declared for " << model_path << " -- skipping the backend comparison" << endl;
+        } else {
+            try {
+                auto fp32_settings = settings;
+                fp32_settings.precision = "float32";
+                fp32_settings.quantization = "none";
+                TorchScriptBackend torchscript_backend(load_and_prepare_model(model_path, fp32_settings));
+                auto comparison = compare_backends(torchscript_backend, *native_backend, inputs,
+                                                   settings.comparison_iterations);
+                comparison.reference_file_bytes = get_file_size_in_bytes(model_path);
+                comparison.candidate_file_bytes = get_file_size_in_bytes(spec_path);
+                cout << comparison.getDescription("native", "torchscript") << endl;
+            } catch (const std::exception& e) {
+                cout << "Backend comparison failed: " << e.what() << endl;
+            }
+        }
+    }
+
+    model = torch::jit::script::Module();
+    installBackend(native_backend, model_path);
+    sharedModel.reset();
+    return true;
+}
+
+void DeploymentThread::installModel(const torch::jit::script::Module& new_model,
+                                    const std::string& new_model_path,
+                                    torch::ScalarType new_model_floating_dtype)
+{
+    model = new_model;
+    installBackend(std::make_shared<TorchScriptBackend>(new_model, new_model_floating_dtype), new_model_path,
+                   new_model_floating_dtype);
+}
+
+void DeploymentThread::installBackend(const std::shared_ptr<InferenceBackend>& new_backend,
+                                      const std::string& new_model_path,
+                                      torch::ScalarType new_model_floating_dtype)
+{
+    backend = new_backend;
+    // worker threads don't see the DPL queues, their jobs are cancelled through the token instead
+    // (see governInferenceJob())
+    backend->setCancellationCheck([this]() {
+        return juce::Thread::getCurrentThread() == this && isDeployCancelled();
+    });
+    installed_model_path = new_model_path;
+    model_floating_dtype = new_model_floating_dtype;
+    isModelLoaded = true;
+
+    // outputs and states of the previous model are no longer valid
+    deployProfiler.rearm();
+    inferenceCache.clear();
+    speculativeBarScheduler.invalidate();
+    modelState.release("model changed");
+
+    // (re)create the workers so that they serve the newly loaded model
+    // (the native engine has no module, its workers just call backend->forward())
+    inferenceWorkerPool.reset();
+    auto* torchscript_module = backend->getModule();
+    auto num_workers = deployment_settings::InferenceWorkerPool::num_workers;
+#if defined(__cpp_impl_coroutine)
+    // deployAsync() can only suspend while a worker runs the inference
+    if (deployment_settings::AsyncDeploy::enable && num_workers <= 0) {
+        std::cout << clr::yellow << "[DPL] async_deploy requires inference_worker_pool.num_workers > 0"
+                  << " -- starting the pool with 1 worker" << std::endl;
+        num_workers = 1;
+    }
+#endif
+    if (num_workers > 0) {
+        inferenceWorkerPool = std::make_unique<InferenceWorkerPool>(
+            torchscript_module != nullptr ? *torchscript_module : torch::jit::script::Module(),
+            num_workers,
+            torchscript_module != nullptr && deployment_settings::InferenceWorkerPool::clone_module_per_worker,
+            [] { apply_thread_scheduling(get_thread_scheduling_settings("torch_workers"), "[DPL worker]"); });
+        cout << "Inference worker pool started with " << inferenceWorkerPool->size()
+             << " workers" << endl;
+
+        // the clones are private heap copies, so the weights are no longer shared
+        auto model_name = std::filesystem::path(installed_model_path).filename().string();
+        if (deployment_settings::InferenceWorkerPool::clone_module_per_worker &&
+            (deployment_settings::ModelSharing::share_across_instances ||
+             get_model_load_settings(model_name).memory_map_weights)) {
+            std::cout << clr::yellow << "[DPL] clone_module_per_worker copies the weights into every worker,"
+                      << " which undoes share_across_instances/memory_map_weights" << std::endl;
+        }
+    }
+    if (deployment_settings::SpeculativeGeneration::enable &&
+        (inferenceWorkerPool == nullptr || torchscript_module == nullptr)) {
+        std::cout << clr::yellow << "[DPL] speculative_generation requires inference_worker_pool.num_workers > 0"
+                  << " (and a TorchScript model) -- speculation is disabled" << std::endl;
+    }
+
+    // keep the weights resident so that inference never waits on page faults
+    lockedModelMemory.release();
+    if (get_thread_scheduling_settings("DeploymentThread").lock_model_memory) {
+        auto tensors = torchscript_module != nullptr ? get_module_tensors(*torchscript_module)
+                                                     : std::vector<torch::Tensor>{};
+        if (torchscript_module == nullptr) {
+            std::cout << clr::yellow << "[DPL] lock_model_memory is only supported for TorchScript models"
+                      << std::endl;
+        } else if (tensors.empty()) {
+            // freeze / optimize_for_inference turn the weights into graph constants
+            std::cout << clr::yellow << "[DPL] lock_model_memory: the model has no tensor attributes (frozen or "
+                      << "optimized for inference?), its weights are not locked" << std::endl;
+        } else {
+            auto all_locked = lockedModelMemory.lock(tensors);
+            std::cout << (all_locked ? clr::green : clr::yellow) << "[DPL] Locked "
+                      << double(lockedModelMemory.getNumLockedBytes()) / (1024.0 * 1024.0) << " MB of model memory"
+                      << (all_locked ? "" : " (some tensors couldn't be locked, check RLIMIT_MEMLOCK)")
+                      << std::endl;
+        }
+    }
+
+    // let the user code (re)declare its buffers for the new model
+    workspace.convertFloatingBuffersTo(model_floating_dtype);
+    onModelInstalled();
+    if (workspace.getMemoryUsageInBytes() > 0) {
+        std::cout << clr::green << "[DPL] " << installed_model_path << " -- " << workspace.getDescription()
+                  << std::endl;
+    }
+}
+
+torch::jit::IValue DeploymentThread::forward(const std::vector<torch::jit::IValue>& inputs)
+{
+    throwIfDeployCancelled();
+    if (backend == nullptr) { throw std::runtime_error("forward() called before a model was loaded"); }
+    auto slot = acquireInferenceSlot();
+    auto forward_timer = timeStage(DeployStage::Forward);
+    at::NoGradGuard no_grad;
+    return backend->forward(inputs);
+}
+
+torch::jit::IValue DeploymentThread::forward(const std::vector<std::string>& workspace_input_names)
+{
+    return forward(workspace.inputs(workspace_input_names));
+}
+
+bool DeploymentThread::swapInReadyModel()
+{
+    if (asyncModelLoader == nullptr) { return false; }
+
+    auto loaded = asyncModelLoader->takeReadyModel();
+    if (!loaded.has_value()) { return false; }
+    // load() was called with another model in the meantime
+    if (loaded->model_path != requested_model_path) {
+        cout << "Discarded model loaded in background: " << loaded->model_path << endl;
+        return false;
+    }
+
+    model_path = loaded->model_path;
+    installModel(loaded->module, loaded->model_path, loaded->floating_dtype);
+    sharedModel = loaded->shared;
+    cout << "Swapped in model: " << loaded->model_path << endl;
+    return true;
+}
+
+std::future<torch::jit::IValue> DeploymentThread::submitInferenceJob(InferenceWorkerPool::Job job)
+{
+    if (backend != nullptr && backend->getModule() == nullptr) {
+        std::promise<torch::jit::IValue> promise;
+        promise.set_exception(std::make_exception_ptr(std::runtime_error(
+            "the model runs on the native engine (no TorchScript module), use forward() or submitInferenceJobs()")));
+        return promise.get_future();
+    }
+    return runInferenceJob(std::move(job));
+}
+
+std::future<torch::jit::IValue> DeploymentThread::runInferenceJob(InferenceWorkerPool::Job job)
+{
+    job = governInferenceJob(std::move(job));
+    if (inferenceWorkerPool != nullptr) {
+        return inferenceWorkerPool->submit(std::move(job));
+    }
+
+    // no pool available, run synchronously and hand back an already completed future
+    std::promise<torch::jit::IValue> promise;
+    try {
+        promise.set_value(job(model));
+    } catch (...) {
+        promise.set_exception(std::current_exception());
+    }
+    return promise.get_future();
+}
+
+std::vector<std::future<torch::jit::IValue>> DeploymentThread::submitInferenceJobs(
+    const std::vector<std::vector<torch::jit::IValue>>& inputs_per_job)
+{
+    std::vector<std::future<torch::jit::IValue>> futures;
+    futures.reserve(inputs_per_job.size());
+    for (const auto& inputs : inputs_per_job) {
+        auto job_backend = backend;
+        futures.push_back(runInferenceJob([inputs, job_backend](torch::jit::script::Module& m) {
+            if (job_backend == nullptr) { throw std::runtime_error("inference submitted before a model was loaded"); }
+            return job_backend->forward(inputs, m);
+        }));
+    }
+    return futures;
+}
+
 [[maybe_unused]] void DeploymentThread::DisplayTensor(const torch::Tensor &tensor, const string& Label,
                                      bool display_content=false){
 
@@ -10,9 +10,31 @@
 #include "../Includes/LockFreeQueue.h"
 #include "../Includes/Configs_Model.h"
 #include "../Includes/colored_cout.h"
+#include "../Includes/chrono_timer.h"
+#include "../Includes/ThreadScheduling.h"
 
 #include "../Includes/GenerationEvent.h"
 #include "../Includes/TorchScriptAndPresetLoaders.h"
+#include "InferenceWorkerPool.h"
+#include "SpeculativeBarScheduler.h"
+#include "InferenceCache.h"
+#include "ModelLoader.h"
+#include "AsyncModelLoader.h"
+#include "SharedModelRegistry.h"
+#include "TensorWorkspace.h"
+#include "TorchThreading.h"
+#include "DeadlineTracker.h"
+#include "LatencyHistogram.h"
+#include "InferenceBackend.h"
+#include "NativeInferenceEngine.h"
+#include "ModelState.h"
+#include "EventHistory.h"
+#include "CancellationToken.h"
+#include "InferenceGovernor.h"
+#include "TensorArena.h"
+#include "DeployProfiler.h"
+#include "LogitsSampler.h"
+#include "DeployTask.h"
 //#include "PluginCode/DeploymentData.h"
 #include "../Includes/MidiDisplayWidget.h"
 
@@ -55,6 +77,41 @@ public:
         bool /*new_midi_file_dropped_on_visualizers*/,
         bool /*new_audio_file_dropped_on_visualizers*/) {return {false, false};}
 
+#if defined(__cpp_impl_coroutine)
+    // ------------------------------------------------------------------------------------------------------------
+    // ---         (Optional) Coroutine variant of deploy(), used instead of deploy() if async_deploy is enabled
+    // ---                  in settings.json. Submit inference with co_await awaitInference(...), the DPL loop
+    // ---                  keeps reading gui parameters and host events until the result is ready.
+    // ---                  The default implementation simply runs deploy().
+    // ---                  NOTE: last_event & co. may already be updated when the coroutine resumes.
+    // ------------------------------------------------------------------------------------------------------------
+    virtual DeployTask deployAsync(
+        std::optional<MidiFileEvent> new_midi_event_dragdrop,
+        std::optional<EventFromHost> new_event_from_host,
+        bool did_any_gui_params_change,
+        bool new_preset_loaded_since_last_call,
+        bool new_midi_file_dropped_on_visualizers,
+        bool new_audio_file_dropped_on_visualizers);
+#endif
+
+    // ------------------------------------------------------------------------------------------------------------
+    // ---         (Optional) Speculative generation for the upcoming bar
+    // ---                  Only called if speculative_generation is enabled in settings.json and the
+    // ---                  inference worker pool is running (num_workers > 0).
+    // ---                  Return a job that generates the bar starting at upcoming_bar_start_ppq using the
+    // ---                  current context, or std::nullopt to skip. The result is claimed in deploy() via
+    // ---                  takeSpeculativeResult() once the corresponding NewBarEvent arrives.
+    // ---                  Called (and the job run) under the same InferenceMode setting as deploy().
+    // ------------------------------------------------------------------------------------------------------------
+    virtual std::optional<InferenceWorkerPool::Job> prepareSpeculativeBarJob(
+        double /*upcoming_bar_start_ppq*/) { return std::nullopt; }
+
+    // ------------------------------------------------------------------------------------------------------------
+    // ---         (Optional) Called on the DPL thread right after a model is loaded or swapped in.
+    // ---                  Use it to declare the workspace buffers needed by the model.
+    // ------------------------------------------------------------------------------------------------------------
+    virtual void onModelInstalled() {}
+
     // ============================================================================================================
 
     // ============================================================================================================
@@ -65,6 +122,22 @@ public:
     bool readyToStop{false}; // Used to check if thread is ready to be stopped or externally stopped
     // ============================================================================================================
 
+    // ============================================================================================================
+    // ===          Stats
+    // ============================================================================================================
+    // number of stale buffer/time-shift events merged since the thread started
+    [[nodiscard]] int64_t getNumberOfCoalescedEvents() const { return coalesced_events_count; }
+    // on-time/missed deadline counts for every model served so far
+    [[nodiscard]] std::map<std::string, DeadlineStats> getDeadlineStats() const { return deadlineTracker.getStats(); }
+    // number of deploy() calls cancelled because newer input arrived (see deployment_settings::Cancellation)
+    [[nodiscard]] int64_t getNumberOfCancelledDeploys() const { return cancelled_deploys_count; }
+    // time forward() calls waited for the process-wide InferenceGovernor (nullptr if disabled)
+    [[nodiscard]] const LatencyHistogram* getInferenceWaitTimes() const { return inferenceWaitTimes; }
+    // peak usage and fallback counters of the deploy() tensor arena (nullptr if disabled)
+    [[nodiscard]] const TensorArena* getTensorArena() const { return tensorArena.get(); }
+    // per-stage deploy() latency histograms (p50/p95/p99 can be read while the thread is running)
+    [[nodiscard]] const DeployLatencyProfiler& getDeployLatencyProfiler() const { return deployLatencyProfiler; }
+
     // ============================================================================================================
     // ===          User Customizable Struct
     // ============================================================================================================
@@ -88,6 +161,11 @@ protected:
     EventFromHost
         last_complete_note_duration_event{};               // keeps metadata of the last beat passed
 
+    // time-indexed history of the received events (see deployment_settings.event_history),
+    // already includes the event passed to the current deploy() call
+    EventHistory eventHistory{(size_t) std::max(1, deployment_settings::EventHistory::max_events),
+                              deployment_settings::EventHistory::horizon_in_quarter_notes};
+
     // Playback 1_RandomGeneration Data
     PlaybackPolicies playbackPolicy;
     PlaybackSequence playbackSequence;
@@ -102,7 +180,46 @@ protected:
     StaticLockFreeQueue<GenerationEvent, queue_settings::DPL2NMP_que_size> *DPL2NMP_GenerationEvent_Que_ptr{};
     StaticLockFreeQueue<juce::MidiFile, 4>* GUI2DPL_DroppedMidiFile_Que_ptr{};
     RealTimePlaybackInfo *realtimePlaybackInfo{};
+    // latest file dropped while a deployAsync() call was pending, deployed once it has finished
+    std::optional<juce::MidiFile> dropped_midi_file;
+    bool hasUserDroppedFilesOnVisualizers();
+    // ============================================================================================================
+
+    // ============================================================================================================
+    // ===          Host Event Coalescing
     // ============================================================================================================
+    // events already pulled out of NMP2DPL_Event_Que but not yet passed to deploy(). Bounded (and
+    // reserved once) to NMP2DPL_que_size, the rest waits in the lock-free queue as before
+    std::vector<EventFromHost> pending_host_events;
+    std::atomic<int64_t> coalesced_events_count{0};
+    void drainHostEventQueue();
+    int coalesceStaleHostEvents();
+    std::optional<EventFromHost> popNextHostEvent();
+
+    // ============================================================================================================
+    // ===          Cancellation of In-Flight Inference (see deployment_settings::Cancellation)
+    // ============================================================================================================
+    // reset before every deploy() call, tripped when higher priority input is queued while deploy() runs.
+    // forward() throws InferenceCancelled once tripped, the result of a cancelled call is not sent and
+    // the next run() iteration starts right away on the newest input
+    std::shared_ptr<CancellationToken> deployCancellationToken{std::make_shared<CancellationToken>()};
+    std::atomic<bool> deploy_in_progress{false};
+    std::atomic<int64_t> cancelled_deploys_count{0};
+    // use inside deploy() between the steps of autoregressive loops, e.g.
+    //      for (int step = 0; step < num_steps; step++) { if (isDeployCancelled()) { return {false, false}; } ... }
+    // safe to call from worker threads (only the DPL thread looks at the queues)
+    bool isDeployCancelled();
+    // same as above, but throws InferenceCancelled
+    void throwIfDeployCancelled();
+    // waits for an inference job, std::nullopt if deploy() was cancelled in the meantime
+    std::optional<torch::jit::IValue> waitForInference(std::future<torch::jit::IValue>& future);
+    // true if notes, gui changes or a playback stop arrived after the current deploy() call started
+    bool hasHigherPriorityInputQueued();
+    // input already queued when the call started doesn't cancel it (e.g. the other notes of a chord),
+    // only what arrived afterwards is checked
+    size_t num_host_events_pending_at_deploy_start{0};
+    int num_gui_params_pending_at_deploy_start{0};
+    int num_gui_params_popped_during_deploy{0};
 
     // ============================================================================================================
     // ===          GuiParameters
@@ -126,8 +243,188 @@ protected:
     // ============================================================================================================
     torch::jit::script::Module model;
     bool isModelLoaded{false};
+    // returns true once model_name_ is the model being served. When loading asynchronously it
+    // returns false while the model loads (isModelLoaded tells if the previous one still serves)
+    // and if the load failed, see getModelLoadState()
     bool load(const std::string& model_name_);
+    // last path load() committed to (when loading asynchronously, only set once the model is swapped in)
     std::string model_path;
+    // path of the model currently being served
+    std::string installed_model_path;
+    // precision the served model runs in (see model_loading.precision in settings.json)
+    torch::ScalarType model_floating_dtype{torch::kFloat32};
+    // runs all inference (forward(), submitInferenceJobs(), awaitInference(inputs)): a TorchScriptBackend
+    // wrapping `model` unless the model runs on the native engine, in which case `model` is empty and
+    // jobs that need the module are rejected
+    std::shared_ptr<InferenceBackend> backend;
+    // weights of the served model locked in RAM (see thread_scheduling.DeploymentThread.lock_model_memory)
+    LockedTensorMemory lockedModelMemory;
+    // keeps the model alive in the SharedModelRegistry while this instance serves it
+    // (nullptr if deployment_settings.model_sharing is disabled)
+    std::shared_ptr<const SharedModel> sharedModel;
+    // replaces the served model and resets everything that depends on it (worker pool, cache, ...)
+    void installModel(const torch::jit::script::Module& new_model, const std::string& new_model_path,
+                      torch::ScalarType new_model_floating_dtype = torch::kFloat32);
+    void installBackend(const std::shared_ptr<InferenceBackend>& new_backend, const std::string& new_model_path,
+                        torch::ScalarType new_model_floating_dtype = torch::kFloat32);
+    // loads <model_name>.native.json if backend is set to "native", returns false if not available
+    bool loadNativeBackend(const std::string& model_name_);
+    // runs backend->forward() with gradients disabled (recorded as DeployStage::Forward)
+    // for reduced precision models, floating point inputs are cast to the model's dtype and
+    // floating point outputs are returned as float32
+    torch::jit::IValue forward(const std::vector<torch::jit::IValue>& inputs);
+    // runs forward() on the listed workspace buffers
+    torch::jit::IValue forward(const std::vector<std::string>& workspace_input_names);
+
+    // ============================================================================================================
+    // ===          Process-Wide Inference Budget (see deployment_settings::InferenceGovernor)
+    // ============================================================================================================
+    int governor_instance_id{-1};
+    const LatencyHistogram* inferenceWaitTimes{nullptr};
+    // wall-clock deadline of the current deploy() call, used to prioritize the instances waiting for a slot
+    std::optional<InferenceGovernor::clock::time_point> inference_deadline;
+    // blocks until the governor grants a slot (returns an empty slot right away if disabled),
+    // throws InferenceCancelled if the deploy() call is cancelled while waiting
+    InferenceGovernor::Slot acquireInferenceSlot();
+    // wraps a job so that it waits for a slot on the thread that runs it (worker or DPL thread) and, while
+    // the DeployProfiler records, runs with the DPL thread's profiler state
+    InferenceWorkerPool::Job governInferenceJob(InferenceWorkerPool::Job job);
+
+    // ============================================================================================================
+    // ===          Execution Context of deploy() (see deployment_settings::ExecutionContext)
+    // ============================================================================================================
+    std::unique_ptr<TensorArena> tensorArena;
+    int64_t num_deploy_contexts{0};
+    // InferenceMode + tensor arena, active from beginDeployCall() to finishDeployCall()
+    std::optional<InferenceExecutionContext> deployContext;
+    void enterInferenceContext();
+    void exitInferenceContext();
+    void printTensorArenaStats();
+
+    // ============================================================================================================
+    // ===          Deploy Call Lifecycle (shared by deploy() and deployAsync())
+    // ============================================================================================================
+    chrono_timer deploy_call_timer;
+    // gui params popped while a deployAsync() call was pending, passed to the next call
+    bool gui_params_received_during_deploy{false};
+    void beginDeployCall();
+    // sends the generated policy/sequence (unless cancelled or late) and records the latency
+    void finishDeployCall(std::pair<bool, bool> status);
+
+#if defined(__cpp_impl_coroutine)
+    // ============================================================================================================
+    // ===          Coroutine Deploy (see deployment_settings::AsyncDeploy)
+    // ============================================================================================================
+    std::optional<DeployTask> pendingDeployTask;
+    PendingInference pendingInference;
+    // submits the inputs (or job) to the worker pool, use with co_await inside deployAsync(). Both take
+    // a governor slot and return float32 outputs, like forward() (a job has to cast its own inputs and
+    // needs the TorchScript module, so it fails with the native engine)
+    InferenceAwaitable awaitInference(const std::vector<torch::jit::IValue>& inputs);
+    InferenceAwaitable awaitInference(InferenceWorkerPool::Job job);
+    // starts deployAsync(), returns the status if it completed without waiting
+    std::optional<std::pair<bool, bool>> startAsyncDeploy(
+        std::optional<MidiFileEvent>& new_midi_event_dragdrop, std::optional<EventFromHost>& new_event_from_host,
+        bool did_any_gui_params_change, bool new_preset_loaded_since_last_call,
+        bool new_midi_file_dropped_on_visualizers, bool new_audio_file_dropped_on_visualizers);
+    // called by run() while a deployAsync() call is pending, returns false once it has finished
+    bool serviceAsyncDeploy();
+#endif
+    // false if coroutines aren't available
+    [[nodiscard]] bool isAsyncDeployPending() const;
+
+    // ============================================================================================================
+    // ===          Operator-Level Profiling (see deployment_settings::Profiling)
+    // ============================================================================================================
+    DeployProfiler deployProfiler{{deployment_settings::Profiling::enable,
+                                   deployment_settings::Profiling::skip_first_n_calls,
+                                   deployment_settings::Profiling::num_deploy_calls,
+                                   deployment_settings::Profiling::record_shapes,
+                                   deployment_settings::Profiling::profile_memory,
+                                   deployment_settings::Profiling::print_top_n_ops}};
+
+    // ============================================================================================================
+    // ===          Token Sampling (see LogitsSampler.h and deployment_settings::LogitsSampler)
+    // ============================================================================================================
+    // use inside deploy(): auto token = logitsSampler.sample(logits, SamplingParams{0.9f, 40, 0.95f});
+    // not thread safe, inference worker pool jobs have to create their own LogitsSampler
+    LogitsSampler logitsSampler{deployment_settings::LogitsSampler::seed};
+
+    // ============================================================================================================
+    // ===          Streaming State (recurrent states, kv caches) kept across deploy() calls
+    // ============================================================================================================
+    ModelState modelState;
+    // resets modelState according to deployment_settings.model_state, called before deploy()
+    void updateModelState(const std::optional<EventFromHost>& new_event_from_host, bool new_preset_loaded);
+    void resetModelState(const std::string& reason);
+
+    // ============================================================================================================
+    // ===          Deploy Latency (see LatencyHistogram.h)
+    // ============================================================================================================
+    DeployLatencyProfiler deployLatencyProfiler;
+    // use inside deploy() to time the tensorize/decode stages: auto timer = timeStage(DeployStage::Decode);
+    DeployLatencyProfiler::ScopedStageTimer timeStage(DeployStage stage) { return deployLatencyProfiler.time(stage); }
+    int64_t num_timed_deploy_calls{0};
+    void recordDeployLatency(int64_t deploy_duration_ns);
+
+    // ============================================================================================================
+    // ===          Deadlines (see deployment_settings::Deadlines)
+    // ============================================================================================================
+    // deadline of the current deploy() call, derived from the triggering EventFromHost (next bar start)
+    std::optional<DeployDeadline> deploy_deadline;
+    // use inside deploy() to replace the default deadline (or std::nullopt to disable it for this call)
+    void setDeployDeadline(std::optional<int64_t> time_in_samples);
+    DeadlineTracker deadlineTracker{parse_deadline_miss_policy(deployment_settings::Deadlines::miss_policy)};
+    // returns false if the generated sequence missed its deadline and should not be sent
+    bool checkDeployDeadline();
+
+    // ============================================================================================================
+    // ===          Preallocated Input/Output Buffers
+    // ============================================================================================================
+    TensorWorkspace workspace;
+
+    // ============================================================================================================
+    // ===          Background Model Loading (see deployment_settings::ModelHotSwap)
+    // ============================================================================================================
+    std::unique_ptr<AsyncModelLoader> asyncModelLoader;
+    // last path requested from asyncModelLoader, older requests are discarded when they finish
+    std::string requested_model_path;
+    // state of the background load of model_name_ (nullopt if never requested asynchronously)
+    std::optional<AsyncModelLoader::RequestState> getModelLoadState(const std::string& model_name_);
+    // called at the top of every run() iteration, returns true if a new model was swapped in
+    bool swapInReadyModel();
+
+    // ============================================================================================================
+    // ===          Parallel Inference (see deployment_settings::InferenceWorkerPool)
+    // ============================================================================================================
+    // created after a model is loaded, nullptr if num_workers is 0
+    std::unique_ptr<InferenceWorkerPool> inferenceWorkerPool;
+    // runs the job on the worker pool if available, otherwise runs it right away on the DPL thread.
+    // Every job takes a slot from the InferenceGovernor before it runs. The job receives the
+    // TorchScript module, so it fails (through the future) if the model runs on the native engine
+    std::future<torch::jit::IValue> submitInferenceJob(InferenceWorkerPool::Job job);
+    // same, for jobs that work with any backend
+    std::future<torch::jit::IValue> runInferenceJob(InferenceWorkerPool::Job job);
+    std::vector<std::future<torch::jit::IValue>> submitInferenceJobs(
+        const std::vector<std::vector<torch::jit::IValue>>& inputs_per_job);
+
+    // ============================================================================================================
+    // ===          Speculative Generation (see deployment_settings::SpeculativeGeneration)
+    // ============================================================================================================
+    SpeculativeBarScheduler speculativeBarScheduler{deployment_settings::SpeculativeGeneration::lookahead_ms};
+    // returns the pre-generated output for the bar starting at bar_start_ppq (if still valid)
+    std::optional<torch::jit::IValue> takeSpeculativeResult(double bar_start_ppq);
+    void updateSpeculativeGeneration();
+
+    // ============================================================================================================
+    // ===          Inference Cache (see deployment_settings::InferenceCache)
+    // ============================================================================================================
+    // cleared whenever a new model is loaded
+    InferenceCache inferenceCache{
+        (size_t) deployment_settings::InferenceCache::max_entries,
+        (size_t) (deployment_settings::InferenceCache::max_memory_mb * 1024 * 1024)};
+    // same as inferenceCache.get(), but also prints the stats periodically if requested in settings.json
+    std::optional<InferenceCache::Entry> getCachedInference(const InferenceCache::Key& key);
     void DisplayTensor(const torch::Tensor &tensor, const string& Label,
                        bool display_content);
 };
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "../Includes/InputEvent.h"
+
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+/*
+ * Ring-buffered history of the EventFromHost objects received by the DPL thread, sorted by time.
+ *
+ * Range queries (by ppq or by samples) use binary search, so they cost O(log n + k) for k
+ * returned events. Consumers that only need the new events since their last call can keep a
+ * Cursor and use getEventsSince(), which costs O(k):
+ *
+ *      // in deploy(): everything played during the last 2 bars
+ *      auto now = new_event_from_host->Time().inQuarterNotes();
+ *      auto events = eventHistory.getEventsInPpqRange(now - 2 * bar_length_ppq, now);
+ *
+ *      // or incrementally
+ *      for (const auto& event : eventHistory.getEventsSince(my_cursor)) { ... }
+ *
+ * Memory is bounded: events older than horizon_ppq (relative to the newest event) are evicted,
+ * as is the oldest event once max_events is reached. When playback stops or the playhead jumps
+ * backwards, the history is cleared (a new timeline starts), so the entries are always
+ * sorted by time.
+ */
+class EventHistory {
+public:
+    struct Cursor {
+        uint64_t next_sequence_number{0};
+        // events evicted before the cursor consumed them
+        uint64_t num_missed{0};
+    };
+
+    EventHistory(size_t max_events_, double horizon_ppq_) :
+        buffer(std::max<size_t>(1, max_events_)), horizon_ppq(horizon_ppq_) {}
+
+    // returns false if the event wasn't stored (e.g. no valid time)
+    bool push(const EventFromHost& event) {
+        if (event.isPlaybackStoppedEvent()) {
+            clear();
+            return false;
+        }
+
+        auto time = event.Time();
+        if (time.inQuarterNotes() < 0 || time.inSamples() < 0) { return false; }
+        if (count > 0 && time.inQuarterNotes() < newest().ppq - kJumpTolerancePpq) { clear(); }
+
+        if (count == buffer.size()) { popOldest(); }
+        buffer[(head + count) % buffer.size()] = Entry{time.inQuarterNotes(), time.inSamples(),
+                                                       next_sequence_number++, event};
+        count++;
+
+        while (count > 1 && horizon_ppq > 0 && oldest().ppq < newest().ppq - horizon_ppq) { popOldest(); }
+        return true;
+    }
+
+    // events with start_ppq <= time < end_ppq
+    [[nodiscard]] std::vector<EventFromHost> getEventsInPpqRange(double start_ppq, double end_ppq) const {
+        return collect(lowerBound([start_ppq](const Entry& e) { return e.ppq < start_ppq; }),
+                       lowerBound([end_ppq](const Entry& e) { return e.ppq < end_ppq; }));
+    }
+
+    // events with start_sample <= time < end_sample
+    [[nodiscard]] std::vector<EventFromHost> getEventsInSampleRange(int64_t start_sample, int64_t end_sample) const {
+        return collect(lowerBound([start_sample](const Entry& e) { return e.samples < start_sample; }),
+                       lowerBound([end_sample](const Entry& e) { return e.samples < end_sample; }));
+    }
+
+    // events received since the last call with the same cursor (advances the cursor)
+    std::vector<EventFromHost> getEventsSince(Cursor& cursor) const {
+        if (count == 0) {
+            cursor.next_sequence_number = std::max(cursor.next_sequence_number, next_sequence_number);
+            return {};
+        }
+
+        auto oldest_sequence_number = oldest().sequence_number;
+        if (cursor.next_sequence_number < oldest_sequence_number) {
+            cursor.num_missed += oldest_sequence_number - cursor.next_sequence_number;
+            cursor.next_sequence_number = oldest_sequence_number;
+        }
+
+        auto first = (size_t) std::min<uint64_t>(cursor.next_sequence_number - oldest_sequence_number, count);
+        cursor.next_sequence_number = next_sequence_number;
+        return collect(first, count);
+    }
+
+    // a cursor that only sees events pushed from now on
+    [[nodiscard]] Cursor makeCursorAtEnd() const { return Cursor{next_sequence_number, 0}; }
+
+    void clear() {
+        // sequence numbers keep increasing so that existing cursors stay valid
+        head = 0;
+        count = 0;
+    }
+
+    [[nodiscard]] size_t size() const { return count; }
+    [[nodiscard]] bool empty() const { return count == 0; }
+    [[nodiscard]] size_t capacity() const { return buffer.size(); }
+    [[nodiscard]] double getHorizonPpq() const { return horizon_ppq; }
+
+    [[nodiscard]] std::string getDescription() const {
+        std::stringstream ss;
+        ss << "Event History | events: " << count << "/" << buffer.size();
+        if (count > 0) { ss << " | ppq: [" << oldest().ppq << ", " << newest().ppq << "]"; }
+        ss << " | horizon: " << horizon_ppq << " ppq | received: " << next_sequence_number;
+        return ss.str();
+    }
+
+private:
+    struct Entry {
+        double ppq{0};
+        int64_t samples{0};
+        uint64_t sequence_number{0};
+        EventFromHost event{};
+    };
+
+    static constexpr double kJumpTolerancePpq{1e-3};
+
+    std::vector<Entry> buffer;
+    size_t head{0};
+    size_t count{0};
+    uint64_t next_sequence_number{0};
+    double horizon_ppq;
+
+    [[nodiscard]] const Entry& at(size_t i) const { return buffer[(head + i) % buffer.size()]; }
+    [[nodiscard]] const Entry& oldest() const { return at(0); }
+    [[nodiscard]] const Entry& newest() const { return at(count - 1); }
+
+    void popOldest() {
+        head = (head + 1) % buffer.size();
+        count--;
+    }
+
+    // index of the first entry for which is_before returns false
+    template <typename Predicate>
+    [[nodiscard]] size_t lowerBound(Predicate is_before) const {
+        size_t low = 0, high = count;
+        while (low < high) {
+            auto mid = low + (high - low) / 2;
+            if (is_before(at(mid))) { low = mid + 1; } else { high = mid; }
+        }
+        return low;
+    }
+
+    [[nodiscard]] std::vector<EventFromHost> collect(size_t first, size_t last) const {
+        std::vector<EventFromHost> events;
+        if (last <= first) { return events; }
+        events.reserve(last - first);
+        for (auto i = first; i < last; i++) { events.push_back(at(i).event); }
+        return events;
+    }
+};
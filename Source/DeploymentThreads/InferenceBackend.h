@@ -0,0 +1,121 @@
+#pragma once
+
+#include <torch/script.h> // One-stop header.
+#include "ModelDiagnostics.h"
+#include "CancellationToken.h"
+#include "ReducedPrecision.h"
+
+#include <functional>
+#include <memory>
+#include <sstream>
+
+/*
+ * Interface through which DeploymentThread runs all inference of the served model
+ * (forward(), submitInferenceJobs(), awaitInference(inputs)).
+ *
+ *      TorchScriptBackend  --> wraps a (prepared) torch::jit::script::Module, casts floating
+ *                              point inputs/outputs for reduced precision models
+ *      NativeBackend       --> small MLP/GRU models run by the native engine
+ *                              (see NativeInferenceEngine.h)
+ *
+ * The backend is chosen per model using model_loading.backend in settings.json.
+ * forward() must be safe to call from several threads at the same time. Inputs and outputs
+ * are always float32 (for floating point tensors).
+ */
+class InferenceBackend {
+public:
+    virtual ~InferenceBackend() = default;
+
+    [[nodiscard]] virtual std::string getName() const = 0;
+
+    virtual torch::jit::IValue forward(const std::vector<torch::jit::IValue>& inputs) = 0;
+
+    // same, on a worker's own copy of the module (inference_worker_pool.clone_module_per_worker),
+    // backends that aren't backed by a module ignore it
+    virtual torch::jit::IValue forward(const std::vector<torch::jit::IValue>& inputs,
+                                       torch::jit::script::Module& /*worker_module*/) {
+        return forward(inputs);
+    }
+
+    // bytes held by the weights of the model
+    [[nodiscard]] virtual size_t getMemoryUsageInBytes() const = 0;
+
+    // nullptr if the backend isn't backed by a TorchScript module
+    virtual torch::jit::script::Module* getModule() { return nullptr; }
+
+    // checked between the steps of forward() (e.g. layers), throws InferenceCancelled once it returns true
+    void setCancellationCheck(std::function<bool()> should_cancel_) { should_cancel = std::move(should_cancel_); }
+
+protected:
+    void throwIfCancelled() const {
+        if (should_cancel && should_cancel()) { throw InferenceCancelled(); }
+    }
+
+private:
+    std::function<bool()> should_cancel;
+};
+
+class TorchScriptBackend : public InferenceBackend {
+public:
+    // floating_dtype: precision the module expects its floating point inputs in
+    explicit TorchScriptBackend(torch::jit::script::Module module_,
+                                torch::ScalarType floating_dtype_ = torch::kFloat32) :
+        module(std::move(module_)), floating_dtype(floating_dtype_) {}
+
+    [[nodiscard]] std::string getName() const override { return "torchscript"; }
+
+    torch::jit::IValue forward(const std::vector<torch::jit::IValue>& inputs) override {
+        return forward(inputs, module);
+    }
+
+    torch::jit::IValue forward(const std::vector<torch::jit::IValue>& inputs,
+                               torch::jit::script::Module& worker_module) override {
+        // a single TorchScript call can't be interrupted, so only check before starting it
+        throwIfCancelled();
+        at::NoGradGuard no_grad;
+        if (floating_dtype == torch::kFloat32) { return worker_module.forward(inputs); }
+        return cast_floating_tensors(worker_module.forward(cast_floating_tensors(inputs, floating_dtype)),
+                                     torch::kFloat32);
+    }
+
+    [[nodiscard]] size_t getMemoryUsageInBytes() const override { return get_module_tensor_bytes(module); }
+
+    torch::jit::script::Module* getModule() override { return &module; }
+
+private:
+    torch::jit::script::Module module;
+    torch::ScalarType floating_dtype;
+};
+
+// ============================================================================================================
+// ===          Benchmark
+// ============================================================================================================
+// runs both backends on the same inputs and reports output differences, median latency and weight memory
+inline ModelComparison compare_backends(InferenceBackend& reference, InferenceBackend& candidate,
+                                        const std::vector<torch::jit::IValue>& inputs, int iterations) {
+    ModelComparison comparison;
+    comparison.reference_tensor_bytes = reference.getMemoryUsageInBytes();
+    comparison.candidate_tensor_bytes = candidate.getMemoryUsageInBytes();
+
+    std::vector<torch::Tensor> reference_outputs, candidate_outputs;
+    collect_output_tensors(reference.forward(inputs), reference_outputs);
+    collect_output_tensors(candidate.forward(inputs), candidate_outputs);
+    compare_output_tensors(reference_outputs, candidate_outputs, comparison);
+
+    auto median_latency_ms = [&](InferenceBackend& backend) {
+        iterations = std::max(1, iterations);
+        backend.forward(inputs); // exclude the first call
+        std::vector<double> latencies_ms;
+        for (int i = 0; i < iterations; i++) {
+            auto start = std::chrono::steady_clock::now();
+            backend.forward(inputs);
+            auto end = std::chrono::steady_clock::now();
+            latencies_ms.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        }
+        std::sort(latencies_ms.begin(), latencies_ms.end());
+        return latencies_ms[latencies_ms.size() / 2];
+    };
+    comparison.reference_latency_ms = median_latency_ms(reference);
+    comparison.candidate_latency_ms = median_latency_ms(candidate);
+    return comparison;
+}
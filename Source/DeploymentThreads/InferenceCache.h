@@ -0,0 +1,259 @@
+#pragma once
+
+#include <torch/script.h> // One-stop header.
+#include "../Includes/GuiParameters.h"
+#include "../Includes/GenerationEvent.h"
+#include "../Includes/TorchScriptAndPresetLoaders.h"
+#include "TensorArena.h"
+
+#include <cstring>
+#include <list>
+#include <optional>
+#include <sstream>
+#include <unordered_map>
+
+/*
+ * Bounded LRU cache for model outputs.
+ *
+ * Entries are keyed by a 64-bit hash built from everything that affects the generation:
+ * input tensors, the gui parameters the model depends on and the CustomPresetData tensors.
+ * The dtypes and shapes of the hashed tensors are stored with the key and compared on lookup,
+ * so a hash collision between differently shaped inputs is a miss. Use it in deploy() to avoid
+ * re-running the model when the user toggles back and forth between the same settings:
+ *
+ *      auto key = InferenceCache::KeyBuilder()
+ *                     .add(input_tensor)
+ *                     .add(gui_params, {"Temperature", "Density"})
+ *                     .add(*CustomPresetData)
+ *                     .get();
+ *
+ *      if (auto cached = inferenceCache.get(key)) {
+ *          output = cached->outputs[0];           // a copy, safe to modify in place
+ *          if (cached->sequence) { playbackSequence = *cached->sequence; }
+ *      } else {
+ *          output = forward({input_tensor}).toTensor();  // DeploymentThread::forward(), not model.forward()
+ *          ... fill playbackSequence ...
+ *          inferenceCache.put(key, {output}, playbackSequence);
+ *      }
+ */
+class InferenceCache {
+public:
+    // ============================================================================================================
+    // ===          Key
+    // ============================================================================================================
+    struct Key {
+        uint64_t hash{0};
+        // dtype, number of dims and sizes of every hashed tensor
+        std::vector<int64_t> tensor_signature;
+
+        bool operator==(const Key &other) const {
+            return hash == other.hash && tensor_signature == other.tensor_signature;
+        }
+    };
+
+    class KeyBuilder {
+    public:
+        KeyBuilder &add(const torch::Tensor &tensor) {
+            if (!tensor.defined()) {
+                key.tensor_signature.push_back(-1);
+                return addValue(uint64_t{0});
+            }
+            auto t = tensor.is_contiguous() ? tensor : tensor.contiguous();
+            addValue(static_cast<int64_t>(t.scalar_type()));
+            for (auto size: t.sizes()) { addValue(size); }
+            key.tensor_signature.push_back(static_cast<int64_t>(t.scalar_type()));
+            key.tensor_signature.push_back(t.dim());
+            key.tensor_signature.insert(key.tensor_signature.end(), t.sizes().begin(), t.sizes().end());
+            if (t.device().is_cpu()) {
+                key.hash = hashBytes(t.data_ptr(), t.nbytes(), key.hash);
+            } else {
+                auto t_cpu = t.cpu();
+                key.hash = hashBytes(t_cpu.data_ptr(), t_cpu.nbytes(), key.hash);
+            }
+            return *this;
+        }
+
+        KeyBuilder &add(const std::vector<torch::Tensor> &tensors) {
+            for (const auto &t: tensors) { add(t); }
+            return *this;
+        }
+
+        // only the values of the listed sliders/rotaries/toggle buttons are used
+        KeyBuilder &add(GuiParams &gui_params, const std::vector<std::string> &labels) {
+            for (const auto &label: labels) {
+                add(label);
+                addValue(gui_params.getValueFor(label));
+            }
+            return *this;
+        }
+
+        KeyBuilder &add(CustomPresetDataDictionary &preset_data) {
+            for (const auto &[key, tensor]: preset_data.items()) {
+                add(key);
+                add(tensor);
+            }
+            return *this;
+        }
+
+        KeyBuilder &add(const std::string &text) {
+            addValue((uint64_t) text.size());
+            key.hash = hashBytes(text.data(), text.size(), key.hash);
+            return *this;
+        }
+
+        template<typename T>
+        KeyBuilder &addValue(const T &value) {
+            static_assert(std::is_trivially_copyable_v<T>, "only trivially copyable values can be hashed");
+            key.hash = hashBytes(&value, sizeof(T), key.hash);
+            return *this;
+        }
+
+        [[nodiscard]] Key get() const { return key; }
+
+    private:
+        Key key{0x9E3779B97F4A7C15ull, {}};
+    };
+
+    // fast non-cryptographic hash, processes 8 bytes per step
+    static uint64_t hashBytes(const void *data, size_t num_bytes, uint64_t seed) {
+        constexpr uint64_t k_mul = 0xff51afd7ed558ccdull;
+        auto bytes = static_cast<const uint8_t *>(data);
+        uint64_t h = seed ^ (num_bytes * k_mul);
+
+        size_t i = 0;
+        for (; i + 8 <= num_bytes; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, bytes + i, 8);
+            h ^= mix(word);
+            h = (h << 27 | h >> 37) * 0x9E3779B97F4A7C15ull + 0x52dce729;
+        }
+
+        if (i < num_bytes) {
+            uint64_t tail = 0;
+            std::memcpy(&tail, bytes + i, num_bytes - i);
+            h ^= mix(tail);
+        }
+
+        return mix(h);
+    }
+
+    // ============================================================================================================
+    // ===          Entries
+    // ============================================================================================================
+    struct Entry {
+        std::vector<torch::Tensor> outputs;
+        std::optional<PlaybackSequence> sequence;
+        size_t num_bytes{0};
+    };
+
+    InferenceCache(size_t max_entries_, size_t max_bytes_) :
+        max_entries(max_entries_), max_bytes(max_bytes_) {}
+
+    // returns a copy of the cached entry (outputs are cloned, so they can be modified in place)
+    // and marks it as most recently used
+    std::optional<Entry> get(const Key &key) {
+        auto it = index.find(key.hash);
+        if (it == index.end() || !(it->second->key == key)) {
+            if (it != index.end()) { num_collisions++; }
+            num_misses++;
+            return std::nullopt;
+        }
+        entries.splice(entries.begin(), entries, it->second);
+        num_hits++;
+
+        auto entry = it->second->entry;
+        for (auto &t: entry.outputs) {
+            if (t.defined()) { t = t.clone(); }
+        }
+        return entry;
+    }
+
+    void put(const Key &key, const std::vector<torch::Tensor> &outputs,
+             std::optional<PlaybackSequence> sequence = std::nullopt) {
+        Entry entry;
+        TensorArena::Suspend persistent; // the entry outlives the deploy() call
+        for (const auto &t: outputs) {
+            // clone, so that in-place changes to the outputs in deploy() don't alter the cache
+            entry.outputs.push_back(t.defined() ? t.detach().clone() : t);
+            entry.num_bytes += t.defined() ? t.nbytes() : 0;
+        }
+        if (sequence.has_value()) {
+            auto num_events = sequence->getAsJuceMidMessageSequence().getNumEvents();
+            entry.num_bytes += (size_t) num_events * sizeof(juce::MidiMessageSequence::MidiEventHolder);
+        }
+        entry.sequence = std::move(sequence);
+
+        if (entry.num_bytes > max_bytes) { return; } // would evict everything else
+
+        erase(key.hash);
+        used_bytes += entry.num_bytes;
+        entries.push_front(Node{key, std::move(entry)});
+        index[key.hash] = entries.begin();
+
+        while (!entries.empty() && (entries.size() > max_entries || used_bytes > max_bytes)) {
+            erase(entries.back().key.hash);
+            num_evictions++;
+        }
+    }
+
+    void clear() {
+        entries.clear();
+        index.clear();
+        used_bytes = 0;
+    }
+
+    [[nodiscard]] size_t size() const { return entries.size(); }
+    [[nodiscard]] size_t getMemoryUsageInBytes() const { return used_bytes; }
+    [[nodiscard]] int64_t getNumLookups() const { return num_hits + num_misses; }
+    [[nodiscard]] double getHitRate() const {
+        auto total = num_hits + num_misses;
+        return total > 0 ? double(num_hits) / double(total) : 0.0;
+    }
+
+    [[nodiscard]] std::string getDescription() const {
+        std::stringstream ss;
+        ss << "Inference Cache | entries: " << entries.size() << "/" << max_entries;
+        ss << " | memory: " << double(used_bytes) / 1024.0 / 1024.0 << "/"
+           << double(max_bytes) / 1024.0 / 1024.0 << " MB";
+        ss << " | hits: " << num_hits << " | misses: " << num_misses << " (collisions: " << num_collisions << ")";
+        ss << " | hit rate: " << getHitRate() * 100.0 << " %";
+        ss << " | evictions: " << num_evictions;
+        return ss.str();
+    }
+
+private:
+    size_t max_entries;
+    size_t max_bytes;
+    size_t used_bytes{0};
+
+    struct Node {
+        Key key;
+        Entry entry;
+    };
+
+    // most recently used entry at the front
+    std::list<Node> entries;
+    std::unordered_map<uint64_t, std::list<Node>::iterator> index;
+
+    int64_t num_hits{0};
+    int64_t num_misses{0};
+    int64_t num_collisions{0};
+    int64_t num_evictions{0};
+
+    void erase(uint64_t hash) {
+        auto it = index.find(hash);
+        if (it == index.end()) { return; }
+        used_bytes -= it->second->entry.num_bytes;
+        entries.erase(it->second);
+        index.erase(it);
+    }
+
+    static uint64_t mix(uint64_t x) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdull;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ull;
+        x ^= x >> 33;
+        return x;
+    }
+};
@@ -0,0 +1,253 @@
+#pragma once
+
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+
+/*
+ * Process-wide admission control for inference, shared by all plugin instances.
+ *
+ * Every DeploymentThread registers with the governor and acquires a slot around each
+ * forward() call and each inference job (worker pool, speculative generation, deployAsync()).
+ * Slots are granted while
+ *
+ *      - fewer than max_concurrent inferences are running, and
+ *      - the CPU time used by inference in the last window_ms stays below the budget
+ *        (cpu_budget_fraction * number of cores * window_ms)
+ *
+ * When several instances wait, the one with the nearest deadline (earliest deadline first)
+ * is served next, waiters without a deadline are served in arrival order after them.
+ * The CPU time of a slot is estimated as its wall time * threads_per_inference.
+ *
+ *      auto slot = InferenceGovernor::instance().acquire(instance_id, deadline, should_cancel);
+ *      if (!slot) { ... }                      // should_cancel() returned true while waiting
+ *      auto out = model.forward(inputs);
+ *      // slot released here
+ *
+ * Waiters sleep on a condition variable: they are woken up when a slot is released, when the
+ * oldest usage leaves the window (if the cpu budget is exhausted) and, if should_cancel is
+ * set, every cancel_poll_interval to check it.
+ */
+class InferenceGovernor {
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct Settings {
+        int max_concurrent{0};              // 0 --> number of cores
+        double cpu_budget_fraction{0.8};    // of all cores, <= 0 --> no cpu budget
+        int window_ms{100};
+        int threads_per_inference{1};
+    };
+
+    // released (and accounted) on destruction
+    class Slot {
+    public:
+        Slot() = default;
+        Slot(InferenceGovernor* governor_, clock::time_point start_) : governor(governor_), start(start_) {}
+        Slot(Slot&& other) noexcept : governor(other.governor), start(other.start) { other.governor = nullptr; }
+        Slot& operator=(Slot&& other) noexcept {
+            if (this != &other) {
+                release();
+                governor = other.governor;
+                start = other.start;
+                other.governor = nullptr;
+            }
+            return *this;
+        }
+        Slot(const Slot&) = delete;
+        Slot& operator=(const Slot&) = delete;
+        ~Slot() { release(); }
+
+        void release() {
+            if (governor != nullptr) { governor->releaseSlot(start); }
+            governor = nullptr;
+        }
+
+    private:
+        InferenceGovernor* governor{nullptr};
+        clock::time_point start{};
+    };
+
+    static InferenceGovernor& instance() {
+        static InferenceGovernor governor;
+        return governor;
+    }
+
+    // applied by the first instance, later calls are ignored so that all instances share one budget
+    void configure(const Settings& settings_) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (is_configured) { return; }
+        settings = settings_;
+        auto num_cores = (int) std::max(1u, std::thread::hardware_concurrency());
+        if (settings.max_concurrent <= 0) { settings.max_concurrent = num_cores; }
+        settings.window_ms = std::max(1, settings.window_ms);
+        settings.threads_per_inference = std::max(1, settings.threads_per_inference);
+        cpu_budget_ns = settings.cpu_budget_fraction > 0 ?
+                        int64_t(settings.cpu_budget_fraction * num_cores * settings.window_ms * 1e6) : 0;
+        is_configured = true;
+    }
+
+    int registerInstance(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto id = next_instance_id++;
+        instances[id] = std::make_unique<InstanceStats>();
+        instances[id]->name = name + " #" + std::to_string(id);
+        return id;
+    }
+
+    void unregisterInstance(int instance_id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        instances.erase(instance_id);
+    }
+
+    // blocks until a slot is granted, or returns std::nullopt once should_cancel() (called without
+    // holding the governor's lock) returns true while waiting
+    std::optional<Slot> acquire(int instance_id, std::optional<clock::time_point> deadline,
+                                const std::function<bool()>& should_cancel = {},
+                                clock::duration cancel_poll_interval = std::chrono::milliseconds(1)) {
+        auto requested = clock::now();
+        std::unique_lock<std::mutex> lock(mutex);
+        auto waiter =
+            waiters.insert(Waiter{deadline.value_or(clock::time_point::max()), next_waiter_sequence++}).first;
+
+        while (true) {
+            auto now = clock::now();
+            pruneWindow(now);
+            auto is_within_budget = cpu_budget_ns <= 0 || window_cpu_ns < cpu_budget_ns;
+            if (waiter == waiters.begin() && active < settings.max_concurrent && is_within_budget) { break; }
+
+            // the window slides even if nobody releases a slot
+            auto wake_up = clock::time_point::max();
+            if (!is_within_budget && !window.empty()) {
+                wake_up = window.front().end + std::chrono::milliseconds(settings.window_ms) +
+                          std::chrono::microseconds(1);
+            }
+            if (should_cancel) { wake_up = std::min(wake_up, now + cancel_poll_interval); }
+            if (wake_up == clock::time_point::max()) {
+                changed.wait(lock);
+            } else {
+                changed.wait_until(lock, wake_up);
+            }
+
+            if (should_cancel) {
+                lock.unlock();
+                auto is_cancelled = should_cancel();
+                lock.lock();
+                if (is_cancelled) {
+                    waiters.erase(waiter);
+                    num_cancelled_waits++;
+                    lock.unlock();
+                    // the next waiter may be at the front now
+                    changed.notify_all();
+                    return std::nullopt;
+                }
+            }
+        }
+
+        waiters.erase(waiter);
+        active++;
+        auto granted = clock::now();
+        auto wait_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(granted - requested).count();
+        if (auto it = instances.find(instance_id); it != instances.end()) { it->second->wait_times.record(wait_ns); }
+        num_grants++;
+        lock.unlock();
+        // the next waiter may also fit
+        changed.notify_all();
+        return Slot(this, granted);
+    }
+
+    // wait times of the instance (nullptr if not registered), readable while inference runs
+    [[nodiscard]] const LatencyHistogram* getWaitTimes(int instance_id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = instances.find(instance_id);
+        return it == instances.end() ? nullptr : &it->second->wait_times;
+    }
+
+    [[nodiscard]] std::string getDescription() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::stringstream ss;
+        ss << "Inference Governor | max concurrent: " << settings.max_concurrent << " | cpu budget: ";
+        if (cpu_budget_ns > 0) {
+            ss << double(cpu_budget_ns) / 1e6 << " ms per " << settings.window_ms << " ms";
+        } else {
+            ss << "none";
+        }
+        ss << " | grants: " << num_grants << " | cancelled waits: " << num_cancelled_waits;
+        for (const auto& [id, stats] : instances) {
+            ss << std::endl << "    " << stats->name << " wait | " << stats->wait_times.getDescription();
+        }
+        return ss.str();
+    }
+
+private:
+    InferenceGovernor() = default;
+
+    struct Waiter {
+        clock::time_point deadline;
+        uint64_t sequence;
+        bool operator<(const Waiter& other) const {
+            return deadline != other.deadline ? deadline < other.deadline : sequence < other.sequence;
+        }
+    };
+
+    struct InstanceStats {
+        std::string name;
+        LatencyHistogram wait_times;
+    };
+
+    struct Usage {
+        clock::time_point end;
+        int64_t cpu_ns;
+    };
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    Settings settings{};
+    bool is_configured{false};
+    int64_t cpu_budget_ns{0};
+
+    std::set<Waiter> waiters;
+    uint64_t next_waiter_sequence{0};
+    int active{0};
+    std::deque<Usage> window;
+    int64_t window_cpu_ns{0};
+    int64_t num_grants{0};
+    int64_t num_cancelled_waits{0};
+
+    std::map<int, std::unique_ptr<InstanceStats>> instances;
+    int next_instance_id{0};
+
+    void releaseSlot(clock::time_point start) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto end = clock::now();
+            auto cpu_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() *
+                          settings.threads_per_inference;
+            window.push_back(Usage{end, cpu_ns});
+            window_cpu_ns += cpu_ns;
+            active--;
+        }
+        changed.notify_all();
+    }
+
+    // drops the usage that finished before the current window
+    void pruneWindow(clock::time_point now) {
+        auto window_start = now - std::chrono::milliseconds(settings.window_ms);
+        while (!window.empty() && window.front().end < window_start) {
+            window_cpu_ns -= window.front().cpu_ns;
+            window.pop_front();
+        }
+    }
+};
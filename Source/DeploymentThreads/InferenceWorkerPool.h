@@ -0,0 +1,142 @@
+#pragma once
+
+#include <torch/script.h> // One-stop header.
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*
+ * A small pool of worker threads used for running several inferences in parallel
+ * (e.g. generating multiple candidates with different seeds/temperatures).
+ *
+ * By default all workers share the same module handle (and with it the weights shared across
+ * instances or memory mapped, see model_sharing / memory_map_weights). TorchScript modules are
+ * safe to call forward() on from multiple threads as long as the forward method doesn't mutate
+ * module attributes. Stateful models can opt into a private deep copy per worker
+ * (clone_module_per_worker = true), at the cost of one heap copy of the weights per worker.
+ *
+ * Jobs are submitted through DeploymentThread::submitInferenceJob(s), which take the
+ * InferenceGovernor slot and apply the reduced precision casts. Usage (inside deploy()):
+ *
+ *      std::vector<std::future<torch::jit::IValue>> futures;
+ *      for (auto temperature : {0.8, 1.0, 1.2}) {
+ *          futures.push_back(submitInferenceJob(
+ *              [=](torch::jit::script::Module& m) { return m.forward({input, temperature}); }));
+ *      }
+ *      auto ranked = InferenceWorkerPool::gatherRanked(futures, my_score_fn);
+ *
+ */
+class InferenceWorkerPool {
+public:
+    using Job = std::function<torch::jit::IValue(torch::jit::script::Module &)>;
+
+    // on_worker_start is called on every worker thread before it picks up jobs (e.g. to set its scheduling)
+    InferenceWorkerPool(const torch::jit::script::Module &model, int num_workers,
+                        bool clone_module_per_worker, std::function<void()> on_worker_start_ = {}) :
+        on_worker_start(std::move(on_worker_start_)) {
+        num_workers = std::max(1, num_workers);
+        for (int i = 0; i < num_workers; i++) {
+            worker_modules.push_back(clone_module_per_worker ? model.clone() : model);
+        }
+        for (int i = 0; i < num_workers; i++) {
+            workers.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    ~InferenceWorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            should_exit = true;
+        }
+        jobs_available.notify_all();
+        for (auto &worker: workers) {
+            if (worker.joinable()) { worker.join(); }
+        }
+    }
+
+    InferenceWorkerPool(const InferenceWorkerPool &) = delete;
+    InferenceWorkerPool &operator=(const InferenceWorkerPool &) = delete;
+
+    // queues a job, the job receives the module owned by the worker that picks it up
+    std::future<torch::jit::IValue> submit(Job job) {
+        std::packaged_task<torch::jit::IValue(torch::jit::script::Module &)> task(std::move(job));
+        auto future = task.get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(task));
+        }
+        jobs_available.notify_one();
+        return future;
+    }
+
+    // blocks until all futures are ready and returns the results in submission order
+    static std::vector<torch::jit::IValue> gather(
+        std::vector<std::future<torch::jit::IValue>> &futures) {
+        std::vector<torch::jit::IValue> results;
+        results.reserve(futures.size());
+        for (auto &future: futures) {
+            results.push_back(future.get());
+        }
+        return results;
+    }
+
+    // blocks until all futures are ready, then sorts the results by score (highest first)
+    static std::vector<std::pair<double, torch::jit::IValue>> gatherRanked(
+        std::vector<std::future<torch::jit::IValue>> &futures,
+        const std::function<double(const torch::jit::IValue &)> &score_fn) {
+        std::vector<std::pair<double, torch::jit::IValue>> ranked;
+        ranked.reserve(futures.size());
+        for (auto &future: futures) {
+            auto result = future.get();
+            auto score = score_fn(result);
+            ranked.emplace_back(score, std::move(result));
+        }
+        std::stable_sort(ranked.begin(), ranked.end(),
+                         [](const auto &a, const auto &b) { return a.first > b.first; });
+        return ranked;
+    }
+
+    [[nodiscard]] int size() const { return (int) workers.size(); }
+
+    [[nodiscard]] size_t getNumPendingJobs() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return jobs.size();
+    }
+
+private:
+    std::function<void()> on_worker_start;
+    std::vector<torch::jit::script::Module> worker_modules;
+    std::vector<std::thread> workers;
+
+    std::deque<std::packaged_task<torch::jit::IValue(torch::jit::script::Module &)>> jobs;
+    std::mutex mutex;
+    std::condition_variable jobs_available;
+    bool should_exit{false};
+
+    void workerLoop(int worker_index) {
+        // grad mode is thread local, so it has to be disabled in every worker
+        at::NoGradGuard no_grad;
+        auto &module = worker_modules[(size_t) worker_index];
+        if (on_worker_start) { on_worker_start(); }
+
+        while (true) {
+            std::packaged_task<torch::jit::IValue(torch::jit::script::Module &)> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobs_available.wait(lock, [this] { return should_exit || !jobs.empty(); });
+                if (should_exit && jobs.empty()) { return; }
+                task = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            // exceptions thrown by the job are forwarded to the future
+            task(module);
+        }
+    }
+};
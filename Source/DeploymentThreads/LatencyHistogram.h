@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <sstream>
+#include <string>
+
+/*
+ * Lock-free log-linear (HDR style) latency histogram.
+ *
+ * Values are recorded in nanoseconds. Every power of two is split into 16 linear
+ * sub-buckets, so any percentile is reported with a relative error below ~6 %,
+ * from 1 ns up to the full int64 range, using a fixed 8 KB of counters.
+ *
+ * record() only uses relaxed atomic increments, so it can be called on the DPL thread while
+ * the percentiles are read from any other thread (e.g. the GUI).
+ */
+class LatencyHistogram {
+public:
+    static constexpr int kSubBucketBits{4};
+    static constexpr int kNumSubBuckets{1 << kSubBucketBits};
+    static constexpr int kNumBuckets{64 * kNumSubBuckets};
+
+    LatencyHistogram() { reset(); }
+
+    void record(int64_t duration_ns) {
+        auto value = duration_ns > 0 ? uint64_t(duration_ns) : uint64_t(0);
+        counts[indexFor(value)].fetch_add(1, std::memory_order_relaxed);
+        total_count.fetch_add(1, std::memory_order_relaxed);
+        sum_ns.fetch_add(value, std::memory_order_relaxed);
+
+        auto prev_max = max_ns.load(std::memory_order_relaxed);
+        while (value > prev_max && !max_ns.compare_exchange_weak(prev_max, value, std::memory_order_relaxed)) {}
+        auto prev_min = min_ns.load(std::memory_order_relaxed);
+        while (value < prev_min && !min_ns.compare_exchange_weak(prev_min, value, std::memory_order_relaxed)) {}
+    }
+
+    // not atomic with respect to concurrent record() calls
+    void reset() {
+        for (auto& count : counts) { count.store(0, std::memory_order_relaxed); }
+        total_count.store(0, std::memory_order_relaxed);
+        sum_ns.store(0, std::memory_order_relaxed);
+        max_ns.store(0, std::memory_order_relaxed);
+        min_ns.store(std::numeric_limits<uint64_t>::max(), std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] uint64_t getCount() const { return total_count.load(std::memory_order_relaxed); }
+
+    // percentile in [0, 100], returns the upper bound of the bucket the percentile falls into
+    [[nodiscard]] int64_t getPercentileNs(double percentile) const {
+        auto count = getCount();
+        if (count == 0) { return 0; }
+
+        auto rank = uint64_t(std::max(1.0, percentile / 100.0 * double(count) + 0.5));
+        uint64_t seen = 0;
+        for (int i = 0; i < kNumBuckets; i++) {
+            seen += counts[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                return int64_t(std::min(upperBoundFor(i), max_ns.load(std::memory_order_relaxed)));
+            }
+        }
+        return int64_t(max_ns.load(std::memory_order_relaxed));
+    }
+
+    [[nodiscard]] double getPercentileMs(double percentile) const { return double(getPercentileNs(percentile)) / 1e6; }
+
+    [[nodiscard]] double getMeanMs() const {
+        auto count = getCount();
+        return count > 0 ? double(sum_ns.load(std::memory_order_relaxed)) / double(count) / 1e6 : 0.0;
+    }
+
+    [[nodiscard]] double getMaxMs() const { return double(max_ns.load(std::memory_order_relaxed)) / 1e6; }
+
+    [[nodiscard]] double getMinMs() const {
+        return getCount() > 0 ? double(min_ns.load(std::memory_order_relaxed)) / 1e6 : 0.0;
+    }
+
+    [[nodiscard]] std::string getDescription() const {
+        std::stringstream ss;
+        ss << "n: " << getCount();
+        ss << " | p50: " << getPercentileMs(50) << " ms";
+        ss << " | p95: " << getPercentileMs(95) << " ms";
+        ss << " | p99: " << getPercentileMs(99) << " ms";
+        ss << " | mean: " << getMeanMs() << " ms";
+        ss << " | min: " << getMinMs() << " ms";
+        ss << " | max: " << getMaxMs() << " ms";
+        return ss.str();
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, kNumBuckets> counts;
+    std::atomic<uint64_t> total_count{0};
+    std::atomic<uint64_t> sum_ns{0};
+    std::atomic<uint64_t> max_ns{0};
+    std::atomic<uint64_t> min_ns{std::numeric_limits<uint64_t>::max()};
+
+    static int mostSignificantBit(uint64_t value) {
+        int msb = 0;
+        while (value >>= 1) { msb++; }
+        return msb;
+    }
+
+    // values below 16 are stored exactly, above that 16 linear sub-buckets per power of two
+    static int indexFor(uint64_t value) {
+        if (value < uint64_t(kNumSubBuckets)) { return int(value); }
+        auto msb = mostSignificantBit(value);
+        auto shift = msb - kSubBucketBits;
+        auto sub_bucket = int((value >> shift) & (kNumSubBuckets - 1));
+        return (shift + 1) * kNumSubBuckets + sub_bucket;
+    }
+
+    static uint64_t upperBoundFor(int index) {
+        if (index < kNumSubBuckets) { return uint64_t(index); }
+        auto shift = index / kNumSubBuckets - 1;
+        auto sub_bucket = uint64_t(index % kNumSubBuckets);
+        auto lower = (uint64_t(kNumSubBuckets) + sub_bucket) << shift;
+        return lower + ((uint64_t(1) << shift) - 1);
+    }
+};
+
+// ============================================================================================================
+// ===          Per-Stage Deploy Timing
+// ============================================================================================================
+/*
+ * Stages of a single deploy() iteration. Total and Push are measured by the DPL thread itself,
+ * forward() records Forward automatically. The remaining stages can be marked in deploy():
+ *
+ *      {
+ *          auto timer = timeStage(DeployStage::Tensorize);
+ *          ... fill input tensors ...
+ *      }
+ *      auto output = forward({input});
+ *      {
+ *          auto timer = timeStage(DeployStage::Decode);
+ *          ... fill playbackSequence ...
+ *      }
+ */
+enum class DeployStage { Total = 0, Tensorize, Forward, Decode, Push, NumStages };
+
+inline const char* get_deploy_stage_name(DeployStage stage) {
+    switch (stage) {
+        case DeployStage::Total: return "total";
+        case DeployStage::Tensorize: return "tensorize";
+        case DeployStage::Forward: return "forward";
+        case DeployStage::Decode: return "decode";
+        case DeployStage::Push: return "push";
+        default: return "unknown";
+    }
+}
+
+class DeployLatencyProfiler {
+public:
+    using clock = std::chrono::steady_clock;
+
+    // records the time between construction and destruction (or stop()) into the stage's histogram
+    class ScopedStageTimer {
+    public:
+        ScopedStageTimer(LatencyHistogram& histogram_, bool enabled_) :
+            histogram(&histogram_), start(enabled_ ? clock::now() : clock::time_point{}), enabled(enabled_) {}
+
+        ScopedStageTimer(ScopedStageTimer&& other) noexcept :
+            histogram(other.histogram), start(other.start), enabled(other.enabled) { other.enabled = false; }
+
+        ScopedStageTimer(const ScopedStageTimer&) = delete;
+        ScopedStageTimer& operator=(const ScopedStageTimer&) = delete;
+        ScopedStageTimer& operator=(ScopedStageTimer&&) = delete;
+
+        ~ScopedStageTimer() { stop(); }
+
+        void stop() {
+            if (!enabled) { return; }
+            enabled = false;
+            histogram->record(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count());
+        }
+
+    private:
+        LatencyHistogram* histogram;
+        clock::time_point start;
+        bool enabled;
+    };
+
+    explicit DeployLatencyProfiler(bool enabled_ = true) : enabled(enabled_) {}
+
+    [[nodiscard]] ScopedStageTimer time(DeployStage stage) { return {get(stage), enabled}; }
+
+    void record(DeployStage stage, int64_t duration_ns) {
+        if (enabled) { get(stage).record(duration_ns); }
+    }
+
+    LatencyHistogram& get(DeployStage stage) { return histograms[size_t(stage)]; }
+    [[nodiscard]] const LatencyHistogram& get(DeployStage stage) const { return histograms[size_t(stage)]; }
+
+    void setEnabled(bool enabled_) { enabled = enabled_; }
+    [[nodiscard]] bool isEnabled() const { return enabled; }
+
+    void reset() {
+        for (auto& histogram : histograms) { histogram.reset(); }
+    }
+
+    [[nodiscard]] std::string getDescription() const {
+        std::stringstream ss;
+        ss << "Deploy Latency";
+        for (size_t i = 0; i < histograms.size(); i++) {
+            if (histograms[i].getCount() == 0) { continue; }
+            ss << std::endl << "    " << get_deploy_stage_name(DeployStage(i)) << " | "
+               << histograms[i].getDescription();
+        }
+        return ss.str();
+    }
+
+private:
+    std::array<LatencyHistogram, size_t(DeployStage::NumStages)> histograms;
+    bool enabled;
+};
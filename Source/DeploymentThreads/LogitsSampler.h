@@ -0,0 +1,326 @@
+#pragma once
+
+#include "shared_plugin_helpers/shared_plugin_helpers.h"
+#include <torch/script.h> // One-stop header.
+#include "../Includes/colored_cout.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <vector>
+
+/*
+ * Sampling of the next token from a row of logits, without going through a chain of small
+ * torch ops (div, topk, softmax, sort, cumsum, multinomial) at every autoregressive step.
+ *
+ *      SamplingParams params;
+ *      params.temperature = 0.9f;
+ *      params.top_k = 40;
+ *      params.top_p = 0.95f;
+ *      params.repetition_penalty = 1.2f;
+ *      params.previous_tokens = generated.data();
+ *      params.num_previous_tokens = generated.size();
+ *
+ *      auto token = logitsSampler.sample(logits.data_ptr<float>(), vocab_size, params);
+ *      // or directly on a [vocab] / [1, vocab] float tensor
+ *      auto token = logitsSampler.sample(logits, params);
+ *
+ * All passes work on one contiguous scratch buffer: the element-wise steps (scaling, top-k
+ * masking, exp) use juce::FloatVectorOperations (SIMD) or branchless loops without loop carried
+ * dependencies, the softmax sum uses several independent accumulators, top-k uses a partial
+ * selection and top-p only sorts the candidates that survived top-k. The final inverse-cdf scan
+ * stays serial. Random numbers come from a seeded xoshiro256** generator, so generations are
+ * reproducible per seed.
+ *
+ * A LogitsSampler owns its scratch buffers and generator state and is not thread safe: use one
+ * instance per thread (e.g. a local sampler inside an inference worker pool job, never
+ * DeploymentThread::logitsSampler, which belongs to the DPL thread).
+ */
+struct SamplingParams {
+    float temperature{1.0f};            // <= 0 --> greedy (argmax)
+    int top_k{0};                       // 0 --> disabled
+    float top_p{1.0f};                  // >= 1 --> disabled
+    float repetition_penalty{1.0f};     // 1 --> disabled (applied to previous_tokens, as in CTRL)
+    const int64_t* previous_tokens{nullptr};
+    size_t num_previous_tokens{0};
+};
+
+// ============================================================================================================
+// ===          Random Number Generator
+// ============================================================================================================
+// xoshiro256** (Blackman & Vigna), seeded with splitmix64
+class Xoshiro256 {
+public:
+    explicit Xoshiro256(uint64_t seed_ = 0) { seed(seed_); }
+
+    void seed(uint64_t value) {
+        for (auto& s : state) {
+            value += 0x9E3779B97F4A7C15ull;
+            auto z = value;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            s = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t next() {
+        auto result = rotl(state[1] * 5, 7) * 9;
+        auto t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return result;
+    }
+
+    // uniform in [0, 1)
+    float uniform() { return float(next() >> 40) * (1.0f / float(1ull << 24)); }
+
+private:
+    uint64_t state[4]{};
+
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+};
+
+// ============================================================================================================
+// ===          Kernels
+// ============================================================================================================
+namespace sampling_kernels {
+
+// exp(x) for x <= 0 (relative error < 2e-7, 0 below -87 and for -inf), branchless so that
+// loops over it vectorize
+inline float fast_exp(float x) {
+    auto clamped = std::max(x, -87.0f);
+    auto n = std::floor(clamped * 1.44269504f + 0.5f);
+    auto r = clamped - n * 0.693147181f;
+    auto p = 1.0f + r * (1.0f + r * (0.5f + r * (0.166666672f + r * (0.0416664891f + r * 0.00833336823f))));
+    int32_t bits = ((int32_t) n + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(float));
+    return x < -87.0f ? 0.0f : p * scale;
+}
+
+// sum of x[0..n) with independent accumulators, so that the additions don't form a single
+// dependency chain (and the loop can vectorize without -ffast-math)
+inline float sum_multi_lane(const float* x, int n) {
+    constexpr int lanes = 8;
+    float partial[lanes]{};
+    int i = 0;
+    for (; i + lanes <= n; i += lanes) {
+        for (int l = 0; l < lanes; l++) { partial[l] += x[i + l]; }
+    }
+    for (; i < n; i++) { partial[0] += x[i]; }
+    float sum = 0.0f;
+    for (auto p : partial) { sum += p; }
+    return sum;
+}
+
+// x[i] = exp(x[i] - max_value), returns the sum
+inline float exp_shifted(float* x, int n, float max_value) {
+    for (int i = 0; i < n; i++) { x[i] = fast_exp(x[i] - max_value); }
+    return sum_multi_lane(x, n);
+}
+
+// CTRL style: positive logits are divided by the penalty, negative ones multiplied. Tokens that
+// occur several times are penalized once (seen: scratch bitmap, all zero between calls)
+inline void apply_repetition_penalty(float* logits, int n, float penalty, const int64_t* tokens, size_t num_tokens,
+                                     std::vector<uint8_t>& seen) {
+    if (penalty == 1.0f || tokens == nullptr) { return; }
+    if (seen.size() < (size_t) n) { seen.resize((size_t) n, 0); }
+    for (size_t i = 0; i < num_tokens; i++) {
+        auto token = tokens[i];
+        if (token < 0 || token >= n || seen[(size_t) token] != 0) { continue; }
+        seen[(size_t) token] = 1;
+        logits[token] = logits[token] > 0 ? logits[token] / penalty : logits[token] * penalty;
+    }
+    // only clear the entries that were set, num_tokens is usually much smaller than n
+    for (size_t i = 0; i < num_tokens; i++) {
+        if (tokens[i] >= 0 && tokens[i] < n) { seen[(size_t) tokens[i]] = 0; }
+    }
+}
+
+// sets everything below the k-th largest value to -inf (ties with the k-th value are kept)
+inline void keep_top_k(float* logits, int n, int k, std::vector<float>& scratch) {
+    if (k <= 0 || k >= n) { return; }
+    scratch.assign(logits, logits + n);
+    std::nth_element(scratch.begin(), scratch.begin() + (k - 1), scratch.end(), std::greater<float>());
+    auto threshold = scratch[(size_t) k - 1];
+    constexpr auto minus_inf = -std::numeric_limits<float>::infinity();
+    for (int i = 0; i < n; i++) { logits[i] = logits[i] < threshold ? minus_inf : logits[i]; }
+}
+
+// probs: unnormalized probabilities (sum = total). Zeroes the tail outside the smallest set of
+// tokens whose probability reaches top_p, returns the new total
+inline float keep_top_p(float* probs, int n, float total, float top_p, std::vector<int>& indices) {
+    if (top_p >= 1.0f || total <= 0.0f) { return total; }
+    indices.clear();
+    for (int i = 0; i < n; i++) {
+        if (probs[i] > 0.0f) { indices.push_back(i); }
+    }
+    std::sort(indices.begin(), indices.end(), [probs](int a, int b) { return probs[a] > probs[b]; });
+
+    auto target = top_p * total;
+    float cumulative = 0.0f;
+    size_t num_kept = 0;
+    while (num_kept < indices.size() && cumulative < target) { cumulative += probs[indices[num_kept++]]; }
+    for (auto i = num_kept; i < indices.size(); i++) { probs[indices[i]] = 0.0f; }
+    return cumulative;
+}
+
+} // namespace sampling_kernels
+
+// ============================================================================================================
+// ===          Sampler
+// ============================================================================================================
+class LogitsSampler {
+public:
+    // seed 0 --> non-deterministic seed
+    explicit LogitsSampler(uint64_t seed_ = 0) { seed(seed_); }
+
+    void seed(uint64_t value) {
+        if (value == 0) {
+            std::random_device device;
+            value = (uint64_t(device()) << 32) ^ device();
+        }
+        rng.seed(value);
+    }
+
+    // logits: n contiguous floats (not modified)
+    int64_t sample(const float* logits, int n, const SamplingParams& params) {
+        using namespace sampling_kernels;
+        if (n <= 0) { return -1; }
+
+        auto* x = copyAndPenalize(logits, n, params);
+
+        if (params.temperature <= 0.0f) { return argmax(x, n); }
+        if (params.temperature != 1.0f) { juce::FloatVectorOperations::multiply(x, 1.0f / params.temperature, n); }
+
+        keep_top_k(x, n, params.top_k, selection_scratch);
+        auto total = exp_shifted(x, n, juce::FloatVectorOperations::findMaximum(x, n));
+        total = keep_top_p(x, n, total, params.top_p, index_scratch);
+        // nothing left to sample from, fall back to greedy (still honouring the penalty)
+        if (!(total > 0.0f)) { return argmax(copyAndPenalize(logits, n, params), n); }
+
+        auto u = rng.uniform() * total;
+        float cumulative = 0.0f;
+        for (int i = 0; i < n; i++) {
+            cumulative += x[i];
+            if (u < cumulative) { return i; }
+        }
+        // rounding: return the last token with a non-zero probability
+        for (int i = n - 1; i >= 0; i--) {
+            if (x[i] > 0.0f) { return i; }
+        }
+        return n - 1;
+    }
+
+    // logits: float tensor with a single row ([vocab] or [1, vocab])
+    int64_t sample(const torch::Tensor& logits, const SamplingParams& params) {
+        auto row = logits.to(torch::kFloat32).contiguous();
+        return sample(row.data_ptr<float>(), (int) row.numel(), params);
+    }
+
+    // one token per row of a [rows, vocab] float tensor
+    std::vector<int64_t> sampleRows(const torch::Tensor& logits, const SamplingParams& params) {
+        auto rows = logits.to(torch::kFloat32).contiguous();
+        auto vocab_size = (int) rows.size(-1);
+        auto num_rows = rows.numel() / std::max(1, vocab_size);
+        std::vector<int64_t> tokens((size_t) num_rows);
+        for (int64_t r = 0; r < num_rows; r++) {
+            tokens[(size_t) r] = sample(rows.data_ptr<float>() + r * vocab_size, vocab_size, params);
+        }
+        return tokens;
+    }
+
+private:
+    Xoshiro256 rng;
+    std::vector<float> buffer;
+    std::vector<float> selection_scratch;
+    std::vector<int> index_scratch;
+    std::vector<uint8_t> seen_scratch;
+
+    // copies the logits to the scratch buffer and applies the repetition penalty there
+    float* copyAndPenalize(const float* logits, int n, const SamplingParams& params) {
+        buffer.resize((size_t) n);
+        auto* x = buffer.data();
+        juce::FloatVectorOperations::copy(x, logits, n);
+        sampling_kernels::apply_repetition_penalty(x, n, params.repetition_penalty, params.previous_tokens,
+                                                   params.num_previous_tokens, seen_scratch);
+        return x;
+    }
+
+    static int64_t argmax(const float* x, int n) { return std::max_element(x, x + n) - x; }
+};
+
+// ============================================================================================================
+// ===          Benchmark
+// ============================================================================================================
+// the torch op chain the sampler replaces (same semantics, used as the benchmark reference)
+inline int64_t sample_with_torch_ops(const torch::Tensor& logits, const SamplingParams& params) {
+    auto x = logits.to(torch::kFloat32).flatten().clone();
+    if (params.repetition_penalty != 1.0f && params.previous_tokens != nullptr && params.num_previous_tokens > 0) {
+        auto ids = torch::from_blob(const_cast<int64_t*>(params.previous_tokens),
+                                    {(int64_t) params.num_previous_tokens}, torch::kLong);
+        // penalize repeated tokens once
+        ids = std::get<0>(at::_unique(ids));
+        auto values = x.index_select(0, ids);
+        x.index_put_({ids}, torch::where(values > 0, values / params.repetition_penalty,
+                                         values * params.repetition_penalty));
+    }
+    if (params.temperature <= 0.0f) { return x.argmax().item<int64_t>(); }
+    x = x / params.temperature;
+    if (params.top_k > 0 && params.top_k < x.size(0)) {
+        auto threshold = std::get<0>(x.topk(params.top_k)).min();
+        x = x.masked_fill(x < threshold, -std::numeric_limits<float>::infinity());
+    }
+    auto probs = torch::softmax(x, 0);
+    if (params.top_p < 1.0f) {
+        auto sorted = probs.sort(0, /*descending=*/true);
+        auto sorted_probs = std::get<0>(sorted);
+        auto cumulative = sorted_probs.cumsum(0);
+        // drop a token if the tokens before it already reach top_p
+        auto remove = (cumulative - sorted_probs) >= params.top_p;
+        probs = probs.scatter(0, std::get<1>(sorted), sorted_probs.masked_fill(remove, 0.0f));
+    }
+    return torch::multinomial(probs, 1).item<int64_t>();
+}
+
+// prints the median latency of both implementations for one row of random logits
+inline void benchmark_logits_sampler(int vocab_size, int iterations, const SamplingParams& params) {
+    at::NoGradGuard no_grad;
+    iterations = std::max(1, iterations);
+    auto logits = torch::randn({vocab_size}) * 3.0;
+    LogitsSampler sampler(1234);
+
+    auto median_us = [iterations](const std::function<void()>& fn) {
+        fn(); // exclude the first call
+        std::vector<double> latencies_us;
+        for (int i = 0; i < iterations; i++) {
+            auto start = std::chrono::steady_clock::now();
+            fn();
+            auto end = std::chrono::steady_clock::now();
+            latencies_us.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+        }
+        std::sort(latencies_us.begin(), latencies_us.end());
+        return latencies_us[latencies_us.size() / 2];
+    };
+
+    auto native_us = median_us([&] { sampler.sample(logits, params); });
+    auto torch_us = median_us([&] { sample_with_torch_ops(logits, params); });
+
+    std::stringstream ss;
+    ss << "Logits sampler benchmark | vocab: " << vocab_size << " | temperature: " << params.temperature
+       << " | top_k: " << params.top_k << " | top_p: " << params.top_p
+       << " | native: " << native_us << " us | torch ops: " << torch_us << " us"
+       << " | speedup: " << (native_us > 0 ? torch_us / native_us : 0.0) << "x";
+    std::cout << clr::green << "[DPL] " << ss.str() << std::endl;
+}
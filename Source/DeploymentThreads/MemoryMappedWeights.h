@@ -0,0 +1,287 @@
+#pragma once
+
+#include "shared_plugin_helpers/shared_plugin_helpers.h"
+#include <torch/script.h> // One-stop header.
+#include "../Includes/json.hpp"
+#include "../Includes/chrono_timer.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+
+#if JUCE_LINUX
+#include <unistd.h>
+#elif JUCE_MAC
+#include <mach/mach.h>
+#endif
+
+#if JUCE_LINUX || JUCE_MAC
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Memory-mapped model weights.
+ *
+ * torch::jit::load deserializes every tensor into private heap memory, so each plugin instance
+ * pays the full read + copy. Instead, the model is converted once into two sidecar files:
+ *
+ *      <model_name>.mmap.pt        --> the TorchScript module with all tensor attributes replaced by
+ *                                      empty placeholders (loads in milliseconds)
+ *      <model_name>.mmap_weights   --> a small json index followed by the raw, 64-byte aligned tensor data
+ *
+ * At load time the weights file is mapped copy-on-write and the module's tensors are pointed
+ * directly at the mapped pages. Pages are faulted in lazily on first use and shared with
+ * every other instance/process mapping the same file, a page that is written to (in-place
+ * update of a parameter or buffer) is copied into private memory first, the file is never modified.
+ *
+ * !! On Windows the weights are mapped read-only: any in-place write to a parameter or buffer of a
+ * !! memory-mapped model crashes the plugin there. Keep memory_map_weights off for such models.
+ *
+ * The sidecars are regenerated automatically when the model file is newer than them. Conversion
+ * writes both files under unique temporary names and renames them into place (weights first,
+ * module last), so instances converting the same model at the same time never see a partially
+ * written file.
+ *
+ * Passes that create new tensors (bf16 conversion, freezing with constant folding, ...) copy the
+ * affected weights to the heap as usual.
+ */
+namespace mmap_weights {
+
+using json = nlohmann::json;
+
+constexpr char kMagic[8] = {'M', 'M', 'A', 'P', 'W', 'T', 'S', '1'};
+constexpr size_t kAlignment{64};
+
+inline std::string get_stripped_module_path(const std::string& model_path) {
+    return std::filesystem::path(model_path).replace_extension(".mmap.pt").string();
+}
+
+inline std::string get_weights_path(const std::string& model_path) {
+    return std::filesystem::path(model_path).replace_extension(".mmap_weights").string();
+}
+
+// ============================================================================================================
+// ===          Resident Memory
+// ============================================================================================================
+// resident set size of the process in bytes (0 if not available on this platform)
+inline size_t get_resident_memory_bytes() {
+#if JUCE_LINUX
+    std::ifstream statm("/proc/self/statm");
+    size_t total_pages{0}, resident_pages{0};
+    if (statm >> total_pages >> resident_pages) { return resident_pages * (size_t) sysconf(_SC_PAGESIZE); }
+    return 0;
+#elif JUCE_MAC
+    mach_task_basic_info info{};
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t) &info, &count) == KERN_SUCCESS) {
+        return (size_t) info.resident_size;
+    }
+    return 0;
+#else
+    return 0;
+#endif
+}
+
+// ============================================================================================================
+// ===          Tensor Attributes
+// ============================================================================================================
+// calls fn(owner, attribute_name, full_name, tensor) for every tensor attribute of the module and its children
+inline void for_each_tensor_attribute(
+    torch::jit::script::Module& module, const std::string& prefix,
+    const std::function<void(torch::jit::script::Module&, const std::string&, const std::string&,
+                             const torch::Tensor&)>& fn) {
+    for (const auto& attribute : module.named_attributes(/*recurse=*/false)) {
+        if (attribute.value.isTensor()) {
+            fn(module, attribute.name, prefix + attribute.name, attribute.value.toTensor());
+        }
+    }
+    for (const auto& child : module.named_children()) {
+        auto child_module = child.value;
+        for_each_tensor_attribute(child_module, prefix + child.name + ".", fn);
+    }
+}
+
+// ============================================================================================================
+// ===          Conversion
+// ============================================================================================================
+inline bool sidecars_are_up_to_date(const std::string& model_path) {
+    std::error_code ec;
+    auto model_time = std::filesystem::last_write_time(model_path, ec);
+    if (ec) { return false; }
+    for (const auto& path : {get_stripped_module_path(model_path), get_weights_path(model_path)}) {
+        auto sidecar_time = std::filesystem::last_write_time(path, ec);
+        if (ec || sidecar_time < model_time) { return false; }
+    }
+    return true;
+}
+
+// unique per call, so that concurrent conversions (other instances/processes) never write the same file
+inline std::string get_temporary_path(const std::string& path) {
+    return path + "." + juce::Uuid().toString().toStdString() + ".tmp";
+}
+
+// magic, header size, json index, then the 64-byte aligned tensor data
+inline void write_weights_file(const std::string& path, const json& index, const std::vector<torch::Tensor>& tensors) {
+    std::ofstream out(path, std::ios::binary);
+    auto header = index.dump();
+    auto header_size = (uint64_t) header.size();
+    out.write(kMagic, sizeof(kMagic));
+    out.write(reinterpret_cast<const char*>(&header_size), sizeof(header_size));
+    out.write(header.data(), (std::streamsize) header.size());
+
+    auto data_start = (sizeof(kMagic) + sizeof(header_size) + header.size() + kAlignment - 1) /
+                      kAlignment * kAlignment;
+    std::vector<char> padding(kAlignment, 0);
+    out.write(padding.data(), (std::streamsize) (data_start - (size_t) out.tellp()));
+
+    for (const auto& tensor : tensors) {
+        out.write(static_cast<const char*>(tensor.data_ptr()), (std::streamsize) tensor.nbytes());
+        auto aligned = (tensor.nbytes() + kAlignment - 1) / kAlignment * kAlignment;
+        out.write(padding.data(), (std::streamsize) (aligned - tensor.nbytes()));
+    }
+    if (!out.good()) { throw std::runtime_error("couldn't write " + path); }
+}
+
+// writes <model_name>.mmap.pt and <model_name>.mmap_weights, throws on failure
+inline void convert_model(const std::string& model_path) {
+    auto module = torch::jit::load(model_path, torch::kCPU);
+
+    json index = json::array();
+    std::vector<torch::Tensor> tensors;
+    size_t offset = 0;
+    for_each_tensor_attribute(module, "", [&](torch::jit::script::Module& owner, const std::string& name,
+                                              const std::string& full_name, const torch::Tensor& tensor) {
+        auto data = tensor.detach().contiguous();
+        index.push_back({{"name", full_name},
+                         {"dtype", (int) data.scalar_type()},
+                         {"shape", data.sizes().vec()},
+                         {"offset", offset},
+                         {"nbytes", data.nbytes()}});
+        tensors.push_back(data);
+        offset += (data.nbytes() + kAlignment - 1) / kAlignment * kAlignment;
+        owner.setattr(name, torch::empty({0}, torch::TensorOptions().dtype(data.scalar_type())));
+    });
+
+    auto weights_path = get_weights_path(model_path);
+    auto module_path = get_stripped_module_path(model_path);
+    auto tmp_path = get_temporary_path(weights_path);
+    auto tmp_module_path = get_temporary_path(module_path);
+    try {
+        write_weights_file(tmp_path, index, tensors);
+        module.save(tmp_module_path);
+
+        // the module is renamed last: sidecars_are_up_to_date() only passes once both files are in place
+        std::filesystem::rename(tmp_path, weights_path);
+        std::filesystem::rename(tmp_module_path, module_path);
+    } catch (...) {
+        std::error_code ec;
+        std::filesystem::remove(tmp_path, ec);
+        std::filesystem::remove(tmp_module_path, ec);
+        throw;
+    }
+}
+
+// ============================================================================================================
+// ===          Mapping
+// ============================================================================================================
+// Maps a whole file copy-on-write (MAP_PRIVATE): pages are shared until written to, a write copies
+// the page instead of faulting or modifying the file. Falls back to a read-only juce::MemoryMappedFile
+// on other platforms (see the note at the top of the file).
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+#if JUCE_LINUX || JUCE_MAC
+        auto fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) { return; }
+        struct stat file_stat{};
+        if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+            auto* mapped = mmap(nullptr, (size_t) file_stat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                data = mapped;
+                size = (size_t) file_stat.st_size;
+            }
+        }
+        close(fd);
+#else
+        read_only_mapping = std::make_unique<juce::MemoryMappedFile>(
+            juce::File(path), juce::MemoryMappedFile::readOnly, /*exclusive=*/false);
+        data = read_only_mapping->getData();
+        size = read_only_mapping->getSize();
+#endif
+    }
+
+    ~MappedFile() {
+#if JUCE_LINUX || JUCE_MAC
+        if (data != nullptr) { munmap(data, size); }
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    [[nodiscard]] char* getData() const { return static_cast<char*>(data); }
+    [[nodiscard]] size_t getSize() const { return size; }
+
+private:
+    void* data{nullptr};
+    size_t size{0};
+#if !(JUCE_LINUX || JUCE_MAC)
+    std::unique_ptr<juce::MemoryMappedFile> read_only_mapping;
+#endif
+};
+
+// ============================================================================================================
+// ===          Loading
+// ============================================================================================================
+// loads the stripped module and points its tensors at the mapped weights, throws on failure
+inline torch::jit::script::Module load_module(const std::string& model_path) {
+    if (!sidecars_are_up_to_date(model_path)) {
+        cout << "Converting " << model_path << " for memory-mapped loading..." << endl;
+        convert_model(model_path);
+    }
+
+    auto weights_path = get_weights_path(model_path);
+    auto mapped = std::make_shared<MappedFile>(weights_path);
+    auto base = mapped->getData();
+    auto file_size = mapped->getSize();
+    if (base == nullptr || file_size < sizeof(kMagic) + sizeof(uint64_t) ||
+        std::memcmp(base, kMagic, sizeof(kMagic)) != 0) {
+        throw std::runtime_error("invalid weights file " + weights_path);
+    }
+
+    uint64_t header_size;
+    std::memcpy(&header_size, base + sizeof(kMagic), sizeof(header_size));
+    auto header_start = sizeof(kMagic) + sizeof(header_size);
+    if (header_start + header_size > file_size) { throw std::runtime_error("corrupted weights file " + weights_path); }
+    auto index = json::parse(base + header_start, base + header_start + header_size);
+    auto data_start = (header_start + header_size + kAlignment - 1) / kAlignment * kAlignment;
+
+    std::map<std::string, torch::Tensor> weights;
+    for (const auto& entry : index) {
+        auto offset = data_start + entry["offset"].get<size_t>();
+        if (offset + entry["nbytes"].get<size_t>() > file_size) {
+            throw std::runtime_error("corrupted weights file " + weights_path);
+        }
+        auto dtype = static_cast<torch::ScalarType>(entry["dtype"].get<int>());
+        // the tensors keep the mapping alive
+        weights[entry["name"].get<std::string>()] = torch::from_blob(
+            base + offset, entry["shape"].get<std::vector<int64_t>>(),
+            [mapped](void*) {}, torch::TensorOptions().dtype(dtype));
+    }
+
+    auto module = torch::jit::load(get_stripped_module_path(model_path), torch::kCPU);
+    for_each_tensor_attribute(module, "", [&](torch::jit::script::Module& owner, const std::string& name,
+                                              const std::string& full_name, const torch::Tensor&) {
+        auto it = weights.find(full_name);
+        if (it == weights.end()) { throw std::runtime_error("missing mapped weight " + full_name); }
+        owner.setattr(name, it->second);
+    });
+    return module;
+}
+
+} // namespace mmap_weights
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <torch/script.h> // One-stop header.
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <sstream>
+
+// ============================================================================================================
+// ===          Output Flattening
+// ============================================================================================================
+// collects all tensors in a forward() output (tensor, tuple, list or dict of tensors)
+inline void collect_output_tensors(const torch::jit::IValue& value, std::vector<torch::Tensor>& tensors) {
+    if (value.isTensor()) {
+        tensors.push_back(value.toTensor());
+    } else if (value.isTuple()) {
+        for (const auto& element : value.toTupleRef().elements()) { collect_output_tensors(element, tensors); }
+    } else if (value.isList()) {
+        for (const auto& element : value.toListRef()) { collect_output_tensors(element, tensors); }
+    } else if (value.isGenericDict()) {
+        for (const auto& item : value.toGenericDict()) { collect_output_tensors(item.value(), tensors); }
+    }
+}
+
+// ============================================================================================================
+// ===          Memory
+// ============================================================================================================
+// bytes held by the tensor parameters/buffers/attributes of the module. Packed weights of
+// quantized layers are custom class objects and not included, use the file size for those.
+inline size_t get_module_tensor_bytes(const torch::jit::script::Module& module) {
+    size_t num_bytes = 0;
+    for (const auto& attribute : module.named_attributes(/*recurse=*/true)) {
+        if (attribute.value.isTensor()) { num_bytes += attribute.value.toTensor().nbytes(); }
+    }
+    return num_bytes;
+}
+
+inline size_t get_file_size_in_bytes(const std::string& path) {
+    std::error_code ec;
+    auto size = std::filesystem::file_size(path, ec);
+    return ec ? 0 : (size_t) size;
+}
+
+// ============================================================================================================
+// ===          Reference vs. Candidate Comparison
+// ============================================================================================================
+/*
+ * Compares a candidate (e.g. quantized or reduced precision) model against the original
+ * fp32 model on the same reference inputs:
+ *
+ *      max_abs_diff / mean_abs_diff   --> over all output tensors (computed in float32)
+ *      *_latency_ms                   --> median forward() latency
+ *      *_file_bytes / *_tensor_bytes  --> size on disk / bytes held by tensor attributes
+ */
+struct ModelComparison {
+    bool outputs_compatible{false};
+    double max_abs_diff{0};
+    double mean_abs_diff{0};
+    double reference_latency_ms{0};
+    double candidate_latency_ms{0};
+    size_t reference_file_bytes{0};
+    size_t candidate_file_bytes{0};
+    size_t reference_tensor_bytes{0};
+    size_t candidate_tensor_bytes{0};
+
+    [[nodiscard]] std::string getDescription(const std::string& candidate_name,
+                                             const std::string& reference_name = "fp32") const {
+        auto to_mb = [](size_t num_bytes) { return double(num_bytes) / 1024.0 / 1024.0; };
+        std::stringstream ss;
+        ss << candidate_name << " vs. " << reference_name;
+        if (outputs_compatible) {
+            ss << std::endl << "    accuracy | max abs diff: " << max_abs_diff
+               << " | mean abs diff: " << mean_abs_diff;
+        } else {
+            ss << std::endl << "    accuracy | outputs have different structure/shapes, not compared";
+        }
+        ss << std::endl << "    latency  | " << reference_name << ": " << reference_latency_ms << " ms | "
+           << candidate_name << ": " << candidate_latency_ms << " ms";
+        if (candidate_latency_ms > 0) { ss << " (x" << reference_latency_ms / candidate_latency_ms << ")"; }
+        ss << std::endl << "    file     | " << reference_name << ": " << to_mb(reference_file_bytes) << " MB | "
+           << candidate_name << ": " << to_mb(candidate_file_bytes) << " MB";
+        ss << std::endl << "    tensors  | " << reference_name << ": " << to_mb(reference_tensor_bytes) << " MB | "
+           << candidate_name << ": " << to_mb(candidate_tensor_bytes) << " MB";
+        return ss.str();
+    }
+};
+
+// fills outputs_compatible, max_abs_diff and mean_abs_diff (computed in float32)
+inline void compare_output_tensors(const std::vector<torch::Tensor>& reference_outputs,
+                                   const std::vector<torch::Tensor>& candidate_outputs,
+                                   ModelComparison& comparison) {
+    comparison.outputs_compatible = !reference_outputs.empty() &&
+                                    reference_outputs.size() == candidate_outputs.size();
+    double sum_abs_diff = 0;
+    int64_t num_elements = 0;
+    for (size_t i = 0; comparison.outputs_compatible && i < reference_outputs.size(); i++) {
+        if (reference_outputs[i].sizes() != candidate_outputs[i].sizes()) {
+            comparison.outputs_compatible = false;
+            break;
+        }
+        auto diff = (reference_outputs[i].to(torch::kFloat32) - candidate_outputs[i].to(torch::kFloat32)).abs();
+        if (diff.numel() == 0) { continue; }
+        comparison.max_abs_diff = std::max(comparison.max_abs_diff, diff.max().item<double>());
+        sum_abs_diff += diff.sum().item<double>();
+        num_elements += diff.numel();
+    }
+    if (num_elements > 0) { comparison.mean_abs_diff = sum_abs_diff / double(num_elements); }
+}
+
+inline double measure_median_forward_latency_ms(torch::jit::script::Module& model,
+                                                const std::vector<torch::jit::IValue>& inputs,
+                                                int iterations) {
+    iterations = std::max(1, iterations);
+    model.forward(inputs); // exclude the first call
+
+    std::vector<double> latencies_ms;
+    for (int i = 0; i < iterations; i++) {
+        auto start = std::chrono::steady_clock::now();
+        model.forward(inputs);
+        auto end = std::chrono::steady_clock::now();
+        latencies_ms.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    std::sort(latencies_ms.begin(), latencies_ms.end());
+    return latencies_ms[latencies_ms.size() / 2];
+}
+
+// candidate_inputs can differ from the reference inputs (e.g. cast to bfloat16),
+// leave empty to use the same inputs for both models
+inline ModelComparison compare_models(torch::jit::script::Module& reference, const std::string& reference_path,
+                                      torch::jit::script::Module& candidate, const std::string& candidate_path,
+                                      const std::vector<torch::jit::IValue>& inputs, int iterations,
+                                      const std::vector<torch::jit::IValue>& candidate_inputs = {}) {
+    at::NoGradGuard no_grad;
+    const auto& inputs_for_candidate = candidate_inputs.empty() ? inputs : candidate_inputs;
+
+    ModelComparison comparison;
+    comparison.reference_file_bytes = get_file_size_in_bytes(reference_path);
+    comparison.candidate_file_bytes = get_file_size_in_bytes(candidate_path);
+    comparison.reference_tensor_bytes = get_module_tensor_bytes(reference);
+    comparison.candidate_tensor_bytes = get_module_tensor_bytes(candidate);
+
+    std::vector<torch::Tensor> reference_outputs, candidate_outputs;
+    collect_output_tensors(reference.forward(inputs), reference_outputs);
+    collect_output_tensors(candidate.forward(inputs_for_candidate), candidate_outputs);
+
+    compare_output_tensors(reference_outputs, candidate_outputs, comparison);
+
+    comparison.reference_latency_ms = measure_median_forward_latency_ms(reference, inputs, iterations);
+    comparison.candidate_latency_ms = measure_median_forward_latency_ms(candidate, inputs_for_candidate, iterations);
+    return comparison;
+}
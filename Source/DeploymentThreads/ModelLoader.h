@@ -0,0 +1,317 @@
+#pragma once
+
+#include <torch/script.h> // One-stop header.
+#include "../Includes/Configs_Model.h"
+#include "../Includes/TorchScriptAndPresetLoaders.h"
+#include "../Includes/chrono_timer.h"
+#include "ModelDiagnostics.h"
+#include "ReducedPrecision.h"
+#include "MemoryMappedWeights.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+
+// ============================================================================================================
+// ===          Warm-up Inputs
+// ============================================================================================================
+// Uses <model_path>.warmup_inputs if available (tensors are passed to forward() in the
+// alphabetical order of their keys), otherwise creates tensors using the shapes/dtypes
+// declared in settings.json. Floating point inputs are cast to floating_dtype (i.e. the
+// precision the model runs in)
+inline std::vector<torch::jit::IValue> make_warmup_inputs(const std::string& model_path,
+                                                          const ModelLoadSettings& settings,
+                                                          torch::ScalarType floating_dtype = torch::kFloat32) {
+    std::vector<torch::jit::IValue> inputs;
+
+    auto sidecar_path = model_path + ".warmup_inputs";
+    std::ifstream sidecar(sidecar_path);
+    if (sidecar.good()) {
+        sidecar.close();
+        for (const auto& [key, tensor] : load_tensor_map_from_path(sidecar_path)) {
+            inputs.emplace_back(tensor);
+        }
+        return cast_floating_tensors(inputs, floating_dtype);
+    }
+
+    for (const auto& spec : settings.warmup_inputs) {
+        auto options = torch::TensorOptions().dtype(spec.dtype);
+        if (c10::isFloatingType(spec.dtype)) {
+            inputs.emplace_back(torch::rand(spec.shape, options));
+        } else {
+            inputs.emplace_back(torch::zeros(spec.shape, options));
+        }
+    }
+    return cast_floating_tensors(inputs, floating_dtype);
+}
+
+// ============================================================================================================
+// ===          Warm-up
+// ============================================================================================================
+// Runs a few forward passes so that the JIT profiling/optimization passes and the first
+// allocations happen at load time instead of during playback. Returns false if forward() fails.
+inline bool warmup_model(torch::jit::script::Module& model,
+                         const std::vector<torch::jit::IValue>& inputs,
+                         int iterations) {
+    if (iterations <= 0) { return true; }
+
+    at::NoGradGuard no_grad;
+    chrono_timer timer;
+    timer.registerStartTime();
+    try {
+        for (int i = 0; i < iterations; i++) {
+            model.forward(inputs);
+        }
+    } catch (const std::exception& e) {
+        cout << "Model warm-up failed (check warmup_inputs in settings.json): " << e.what() << endl;
+        return false;
+    }
+    timer.registerEndTime();
+    cout << "Model warmed up with " << iterations << " forward passes"
+         << timer.getDescription().value_or("") << endl;
+    return true;
+}
+
+// ============================================================================================================
+// ===          Dynamic Int8 Quantization
+// ============================================================================================================
+/*
+ * libtorch has no C++ equivalent of torch.ao.quantization.quantize_dynamic for TorchScript
+ * modules, so the quantized model is exported once from python and cached next to the
+ * original one:
+ *
+ *      q = torch.ao.quantization.quantize_dynamic(model, {torch.nn.Linear, torch.nn.LSTM, torch.nn.GRU},
+ *                                                 dtype=torch.qint8)
+ *      torch.jit.save(torch.jit.script(q), "<model_name>.dynamic_int8.pt")
+ *
+ * i.e. "drums.pt" --> "drums.dynamic_int8.pt"
+ */
+inline std::string get_quantized_model_path(const std::string& model_path) {
+    return std::filesystem::path(model_path).replace_extension(".dynamic_int8.pt").string();
+}
+
+// the quantized kernels need a backend engine: fbgemm/x86 on x86, qnnpack on arm
+inline bool select_quantized_engine() {
+    static std::once_flag flag;
+    static bool is_available{false};
+    std::call_once(flag, [] {
+        const auto& engines = at::globalContext().supportedQEngines();
+        for (auto preferred : {at::QEngine::X86, at::QEngine::FBGEMM, at::QEngine::QNNPACK}) {
+            if (std::find(engines.begin(), engines.end(), preferred) != engines.end()) {
+                at::globalContext().setQEngine(preferred);
+                is_available = true;
+                cout << "Quantized engine: " << c10::toString(preferred) << endl;
+                return;
+            }
+        }
+        cout << "No quantized engine available in this libtorch build" << endl;
+    });
+    return is_available;
+}
+
+// returns the file that should actually be loaded for model_path
+inline std::string resolve_model_file(const std::string& model_path, const ModelLoadSettings& settings) {
+    if (settings.quantization == "none") { return model_path; }
+
+    if (settings.quantization != "dynamic_int8") {
+        cout << "Unknown quantization: " << settings.quantization << " -- using the fp32 model" << endl;
+        return model_path;
+    }
+
+    auto quantized_path = get_quantized_model_path(model_path);
+    if (!std::filesystem::exists(quantized_path)) {
+        cout << "Quantized model not found at " << quantized_path << " -- using the fp32 model" << endl;
+        return model_path;
+    }
+    if (!select_quantized_engine()) { return model_path; }
+    return quantized_path;
+}
+
+// ============================================================================================================
+// ===          Loading (heap or memory-mapped)
+// ============================================================================================================
+// loads the TorchScript file and reports the load time and the change in resident memory
+inline torch::jit::script::Module load_module(const std::string& model_file, const ModelLoadSettings& settings) {
+    auto rss_before = mmap_weights::get_resident_memory_bytes();
+    chrono_timer timer;
+    timer.registerStartTime();
+
+    torch::jit::script::Module model;
+    auto is_memory_mapped = false;
+    if (settings.memory_map_weights) {
+        try {
+            model = mmap_weights::load_module(model_file);
+            is_memory_mapped = true;
+        } catch (const std::exception& e) {
+            cout << "Memory-mapped loading failed, loading into memory instead: " << e.what() << endl;
+        }
+    }
+    if (!is_memory_mapped) { model = torch::jit::load(model_file, torch::kCPU); }
+
+    timer.registerEndTime();
+    auto rss_after = mmap_weights::get_resident_memory_bytes();
+    cout << "Loaded " << model_file << (is_memory_mapped ? " (memory mapped)" : "")
+         << timer.getDescription(" | load time: ").value_or("");
+    if (rss_before > 0 && rss_after > 0) {
+        cout << " | resident memory: " << (double(rss_after) - double(rss_before)) / 1024.0 / 1024.0 << " MB";
+    }
+    cout << endl;
+    return model;
+}
+
+// ============================================================================================================
+// ===          Reduced Precision (bfloat16)
+// ============================================================================================================
+// returns the dtype the model should run in, falls back to float32 if bf16 isn't natively supported
+inline torch::ScalarType get_requested_precision(const ModelLoadSettings& settings) {
+    if (settings.precision == "float32") { return torch::kFloat32; }
+    if (settings.precision != "bfloat16") {
+        cout << "Unknown precision: " << settings.precision << " -- using float32" << endl;
+        return torch::kFloat32;
+    }
+    if (!cpu_supports_native_bf16() && !settings.allow_emulated_bf16) {
+        cout << "CPU has no native bf16 support (AVX512_BF16/AMX) -- using float32" << endl;
+        return torch::kFloat32;
+    }
+    return torch::kBFloat16;
+}
+
+// Converts the parameters of the (unfrozen) fp32 model to bf16. If warm-up inputs are available,
+// the outputs are compared against the fp32 model and the fp32 model is kept if the max abs
+// difference exceeds settings.precision_tolerance.
+inline torch::jit::script::Module convert_to_bf16_if_within_tolerance(torch::jit::script::Module& model,
+                                                                      const std::string& model_path,
+                                                                      const ModelLoadSettings& settings,
+                                                                      torch::ScalarType& floating_dtype) {
+    auto candidate = model.clone();
+    candidate.to(torch::kBFloat16);
+
+    auto inputs = make_warmup_inputs(model_path, settings);
+    if (inputs.empty()) {
+        cout << "No warm-up inputs declared for " << model_path << " -- bf16 tolerance not checked" << endl;
+        floating_dtype = torch::kBFloat16;
+        return candidate;
+    }
+
+    try {
+        auto comparison = compare_models(model, model_path, candidate, model_path, inputs,
+                                         settings.comparison_iterations,
+                                         cast_floating_tensors(inputs, torch::kBFloat16));
+        cout << comparison.getDescription("bfloat16") << endl;
+        if (!comparison.outputs_compatible || comparison.max_abs_diff > settings.precision_tolerance) {
+            cout << "bf16 outputs exceed the tolerance of " << settings.precision_tolerance
+                 << " -- using float32" << endl;
+            return model;
+        }
+    } catch (const std::exception& e) {
+        cout << "bf16 model failed to run, using float32: " << e.what() << endl;
+        return model;
+    }
+
+    floating_dtype = torch::kBFloat16;
+    return candidate;
+}
+
+// ============================================================================================================
+// ===          Load + Prepare
+// ============================================================================================================
+// Loads the TorchScript file and applies the optimizations requested in settings.
+// Throws (same as torch::jit::load) if the file can't be loaded. Optimization
+// failures are reported and the unoptimized module is used instead.
+// If floating_dtype is provided, it is set to the precision the returned model expects its
+// floating point inputs in.
+inline torch::jit::script::Module load_and_prepare_model(const std::string& model_path,
+                                                         const ModelLoadSettings& settings,
+                                                         torch::ScalarType* floating_dtype = nullptr) {
+    auto model_file = resolve_model_file(model_path, settings);
+    auto model = load_module(model_file, settings);
+    model.eval();
+    if (model_file != model_path) { cout << "Loaded " << settings.quantization << " model: " << model_file << endl; }
+
+    // precision has to be changed before freezing inlines the parameters
+    auto model_dtype = torch::kFloat32;
+    if (get_requested_precision(settings) == torch::kBFloat16) {
+        if (model_file != model_path) {
+            cout << "bf16 precision is ignored for quantized models" << endl;
+        } else {
+            model = convert_to_bf16_if_within_tolerance(model, model_path, settings, model_dtype);
+        }
+    }
+    if (floating_dtype != nullptr) { *floating_dtype = model_dtype; }
+
+    if (settings.optimize_for_inference) {
+        try {
+            // freezes the module internally if not already frozen
+            model = torch::jit::optimize_for_inference(model);
+            cout << "Model frozen and optimized for inference" << endl;
+        } catch (const std::exception& e) {
+            cout << "optimize_for_inference failed, using the unoptimized model: " << e.what() << endl;
+        }
+    } else if (settings.freeze) {
+        try {
+            model = torch::jit::freeze(model);
+            cout << "Model frozen" << endl;
+        } catch (const std::exception& e) {
+            cout << "Freezing failed, using the unfrozen model: " << e.what() << endl;
+        }
+    }
+
+    if (settings.warmup_iterations > 0) {
+        auto inputs = make_warmup_inputs(model_path, settings, model_dtype);
+        if (inputs.empty()) {
+            cout << "No warm-up inputs declared for " << model_path << " -- skipping warm-up" << endl;
+        } else {
+            warmup_model(model, inputs, settings.warmup_iterations);
+        }
+    }
+
+    if (model_file != model_path && settings.compare_with_fp32) {
+        auto inputs = make_warmup_inputs(model_path, settings);
+        if (inputs.empty()) {
+            cout << "No warm-up inputs declared for " << model_path << " -- skipping the fp32 comparison" << endl;
+        } else {
+            try {
+                auto fp32_settings = settings;
+                fp32_settings.quantization = "none";
+                fp32_settings.compare_with_fp32 = false;
+                fp32_settings.warmup_iterations = 0;
+                fp32_settings.precision = "float32";
+                auto reference = load_and_prepare_model(model_path, fp32_settings);
+                auto comparison = compare_models(reference, model_path, model, model_file, inputs,
+                                                 settings.comparison_iterations);
+                cout << comparison.getDescription(settings.quantization) << endl;
+            } catch (const std::exception& e) {
+                cout << "Comparison with the fp32 model failed: " << e.what() << endl;
+            }
+        }
+    }
+
+    return model;
+}
+
+// ============================================================================================================
+// ===          Validation
+// ============================================================================================================
+// Checks that the module has a forward method and, if warm-up inputs are declared,
+// that forward() runs on them. Used before swapping a model in at runtime.
+inline bool validate_model(torch::jit::script::Module& model, const std::string& model_path,
+                           const ModelLoadSettings& settings,
+                           torch::ScalarType floating_dtype = torch::kFloat32) {
+    if (!model.find_method("forward").has_value()) {
+        cout << "Model at " << model_path << " has no forward method" << endl;
+        return false;
+    }
+
+    auto inputs = make_warmup_inputs(model_path, settings, floating_dtype);
+    if (inputs.empty()) { return true; }
+
+    at::NoGradGuard no_grad;
+    try {
+        model.forward(inputs);
+    } catch (const std::exception& e) {
+        cout << "Model at " << model_path << " failed validation: " << e.what() << endl;
+        return false;
+    }
+    return true;
+}
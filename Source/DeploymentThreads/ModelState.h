@@ -0,0 +1,191 @@
+#pragma once
+
+#include <torch/script.h> // One-stop header.
+#include "../Includes/InputEvent.h"
+#include "TensorArena.h"
+
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <sstream>
+
+/*
+ * Fixed capacity key/value cache for incremental (streaming) transformer inference.
+ *
+ * Storage is allocated once as [batch, heads, capacity, head_dim] (the time dimension can be
+ * changed with time_dim). append() writes the new steps in place, view() returns the valid
+ * part without copying. Once more than max_length steps have been appended, the cache keeps
+ * the most recent max_length steps (the window is moved back to the start of the buffer,
+ * which costs one copy every (capacity - max_length) steps).
+ */
+class KVCache {
+public:
+    KVCache() = default;
+
+    KVCache(at::IntArrayRef shape_without_time, int64_t max_length_, int64_t time_dim_ = 2,
+            torch::ScalarType dtype = torch::kFloat32) :
+        max_length(max_length_), time_dim(time_dim_) {
+        auto shape = shape_without_time.vec();
+        shape.insert(shape.begin() + time_dim, 2 * max_length);
+        TensorArena::Suspend persistent; // the cache outlives the deploy() call
+        storage = torch::zeros(shape, torch::TensorOptions().dtype(dtype));
+    }
+
+    // steps: same shape as the storage except for the time dimension
+    void append(const torch::Tensor& steps) {
+        auto num_new = steps.size(time_dim);
+        if (num_new >= max_length) {
+            storage.narrow(time_dim, 0, max_length).copy_(steps.narrow(time_dim, num_new - max_length, max_length));
+            start = 0;
+            length = max_length;
+            return;
+        }
+
+        auto capacity = storage.size(time_dim);
+        if (start + length + num_new > capacity) {
+            // keep the last (max_length - num_new) steps and move them to the front
+            auto keep = std::min(length, max_length - num_new);
+            auto kept = storage.narrow(time_dim, start + length - keep, keep).clone();
+            storage.narrow(time_dim, 0, keep).copy_(kept);
+            start = 0;
+            length = keep;
+        }
+
+        storage.narrow(time_dim, start + length, num_new).copy_(steps);
+        length += num_new;
+        if (length > max_length) {
+            start += length - max_length;
+            length = max_length;
+        }
+    }
+
+    // the cached steps (no copy)
+    [[nodiscard]] torch::Tensor view() const { return storage.narrow(time_dim, start, length); }
+
+    [[nodiscard]] int64_t size() const { return length; }
+    [[nodiscard]] bool empty() const { return length == 0; }
+    [[nodiscard]] size_t getMemoryUsageInBytes() const { return storage.defined() ? storage.nbytes() : 0; }
+
+    void clear() {
+        start = 0;
+        length = 0;
+    }
+
+private:
+    torch::Tensor storage;
+    int64_t max_length{0};
+    int64_t time_dim{2};
+    int64_t start{0};
+    int64_t length{0};
+};
+
+/*
+ * State kept by the model between deploy() calls (recurrent hidden states, KV caches, the
+ * number of steps already encoded, ...), so that every call only needs to process the new
+ * inputs instead of re-encoding the whole context:
+ *
+ *      // in deploy()
+ *      auto h = modelState.get("hidden");     // std::nullopt after a reset
+ *      auto out = forward({new_steps, h.value_or(torch::jit::IValue())}).toTuple();
+ *      modelState.set("hidden", out->elements()[1]);
+ *
+ *      auto& keys = modelState.kvCache("keys", {1, 4, 64}, 512);
+ *      keys.append(new_keys);
+ *
+ * The DPL thread resets the state automatically (see deployment_settings.model_state) when
+ * playback stops, when the playhead jumps backwards (e.g. loops or relocation), when a preset
+ * is loaded and when a new model is installed.
+ */
+class ModelState {
+public:
+    ModelState() = default;
+
+    [[nodiscard]] bool has(const std::string& name) const { return values.find(name) != values.end(); }
+
+    [[nodiscard]] std::optional<torch::jit::IValue> get(const std::string& name) const {
+        auto it = values.find(name);
+        if (it == values.end()) { return std::nullopt; }
+        return it->second;
+    }
+
+    // if a tensor arena is active (deployment_settings.execution_context.tensor_arena), the tensors
+    // are copied out of it, otherwise the arena would have to retire its block after every call
+    void set(const std::string& name, torch::jit::IValue value) {
+        values[name] = TensorArena::isActiveOnThisThread() ? TensorArena::copyOut(value) : std::move(value);
+    }
+
+    // returns the cache, creating it on first use
+    KVCache& kvCache(const std::string& name, at::IntArrayRef shape_without_time, int64_t max_length,
+                     int64_t time_dim = 2, torch::ScalarType dtype = torch::kFloat32) {
+        auto it = kv_caches.find(name);
+        if (it == kv_caches.end()) {
+            it = kv_caches.emplace(name, KVCache(shape_without_time, max_length, time_dim, dtype)).first;
+        }
+        return it->second;
+    }
+
+    // number of steps (tokens/frames) encoded since the last reset, maintained by the user code
+    int64_t num_steps{0};
+
+    [[nodiscard]] bool isEmpty() const { return values.empty() && num_steps == 0 && allCachesEmpty(); }
+
+    // clears all values, empties (but keeps the memory of) all KV caches
+    void reset(const std::string& reason) {
+        if (isEmpty()) { return; }
+        values.clear();
+        for (auto& [name, cache] : kv_caches) { cache.clear(); }
+        num_steps = 0;
+        num_resets++;
+        last_reset_reason = reason;
+    }
+
+    // drops everything including the KV cache buffers (e.g. when the model changes)
+    void release(const std::string& reason) {
+        reset(reason);
+        kv_caches.clear();
+    }
+
+    // detects stops and backward jumps of the playhead, returns the reason if the state should be reset
+    std::optional<std::string> observe(const EventFromHost& event) {
+        if (event.isPlaybackStoppedEvent()) {
+            last_ppq.reset();
+            return "playback stopped";
+        }
+        auto ppq = event.Time().inQuarterNotes();
+        if (ppq < 0) { return std::nullopt; }
+
+        std::optional<std::string> reason;
+        if (last_ppq.has_value() && ppq < *last_ppq - kJumpTolerancePpq) { reason = "playhead jumped backwards"; }
+        last_ppq = ppq;
+        return reason;
+    }
+
+    [[nodiscard]] int64_t getNumResets() const { return num_resets; }
+
+    [[nodiscard]] std::string getDescription() const {
+        size_t num_bytes = 0;
+        for (const auto& [name, cache] : kv_caches) { num_bytes += cache.getMemoryUsageInBytes(); }
+        std::stringstream ss;
+        ss << "Model State | values: " << values.size() << " | kv caches: " << kv_caches.size()
+           << " (" << double(num_bytes) / 1024.0 << " KB)" << " | steps: " << num_steps
+           << " | resets: " << num_resets;
+        if (!last_reset_reason.empty()) { ss << " (last: " << last_reset_reason << ")"; }
+        return ss.str();
+    }
+
+private:
+    static constexpr double kJumpTolerancePpq{1e-3};
+
+    std::map<std::string, torch::jit::IValue> values;
+    std::map<std::string, KVCache> kv_caches;
+    std::optional<double> last_ppq;
+    int64_t num_resets{0};
+    std::string last_reset_reason;
+
+    [[nodiscard]] bool allCachesEmpty() const {
+        for (const auto& [name, cache] : kv_caches) {
+            if (!cache.empty()) { return false; }
+        }
+        return true;
+    }
+};
@@ -0,0 +1,338 @@
+#pragma once
+
+#include "shared_plugin_helpers/shared_plugin_helpers.h"
+#include <torch/script.h> // One-stop header.
+#include "../Includes/json.hpp"
+#include "../Includes/TorchScriptAndPresetLoaders.h"
+#include "InferenceBackend.h"
+
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+
+/*
+ * Engine for small MLP/GRU models. It skips the TorchScript interpreter and runs hand-written
+ * float32 kernels on the exported weights. It still uses torch::Tensor for its inputs, outputs
+ * and weights, so it doesn't reduce the libtorch dependency or the binary footprint, only the
+ * per-call JIT overhead. The matrix products are written as vectorized axpy updates using
+ * juce::FloatVectorOperations (SSE/AVX/NEON).
+ *
+ * There is no torch::jit::script::Module while it serves a model, so inference jobs that need
+ * one (DeploymentThread::submitInferenceJob(), awaitInference(Job), speculative generation)
+ * are rejected, use forward(), submitInferenceJobs() or awaitInference(inputs) instead.
+ *
+ * A model is described by <model_name>.native.json next to the TorchScript file
+ * (e.g. drums.pt --> drums.native.json):
+ *
+ *      {
+ *          "weights": "drums.native.weights",
+ *          "layers": [
+ *              {"type": "gru", "prefix": "encoder", "return": "sequence"},
+ *              {"type": "linear", "prefix": "fc1"},
+ *              {"type": "relu"},
+ *              {"type": "linear", "prefix": "fc2"},
+ *              {"type": "sigmoid"}
+ *          ]
+ *      }
+ *
+ * The weights file uses the save_tensor_map format, with the same keys as the pytorch state_dict
+ * (fc1.weight, fc1.bias, encoder.weight_ih_l0, encoder.bias_hh_l0, ...).
+ *
+ * Supported layers:
+ *      linear                         --> applied to the last dimension
+ *      relu, tanh, sigmoid, gelu      --> element-wise
+ *      softmax                        --> over the last dimension
+ *      gru                            --> single layer, batch_first, zero initial state,
+ *                                         input [batch, time, features]
+ *                                         "return": "sequence" [batch, time, hidden] or "last" [batch, hidden]
+ *
+ * Only the first input passed to forward() is used, it is converted to float32 if needed.
+ */
+namespace native_engine {
+
+using json = nlohmann::json;
+
+// ============================================================================================================
+// ===          Kernels
+// ============================================================================================================
+// y[n, :] = bias + x[n, :] * W^T   with W^T stored as [in, out] so that every input
+// feature adds a contiguous (vectorizable) row to the output
+inline void linear(const float* x, float* y, int64_t num_rows, int in_features, int out_features,
+                   const float* weight_t, const float* bias) {
+    for (int64_t n = 0; n < num_rows; n++) {
+        auto x_row = x + n * in_features;
+        auto y_row = y + n * out_features;
+        if (bias != nullptr) {
+            juce::FloatVectorOperations::copy(y_row, bias, out_features);
+        } else {
+            juce::FloatVectorOperations::clear(y_row, out_features);
+        }
+        for (int i = 0; i < in_features; i++) {
+            if (x_row[i] == 0.0f) { continue; }
+            juce::FloatVectorOperations::addWithMultiply(y_row, weight_t + (int64_t) i * out_features,
+                                                         x_row[i], out_features);
+        }
+    }
+}
+
+inline void relu(float* x, int64_t num_elements) {
+    juce::FloatVectorOperations::max(x, x, 0.0f, (int) num_elements);
+}
+
+inline float sigmoid(float x) { return 1.0f / (1.0f + std::exp(-x)); }
+
+inline void sigmoid(float* x, int64_t num_elements) {
+    for (int64_t i = 0; i < num_elements; i++) { x[i] = sigmoid(x[i]); }
+}
+
+inline void tanh(float* x, int64_t num_elements) {
+    for (int64_t i = 0; i < num_elements; i++) { x[i] = std::tanh(x[i]); }
+}
+
+inline void gelu(float* x, int64_t num_elements) {
+    for (int64_t i = 0; i < num_elements; i++) { x[i] = 0.5f * x[i] * (1.0f + std::erf(x[i] * 0.70710678f)); }
+}
+
+inline void softmax(float* x, int64_t num_rows, int num_columns) {
+    for (int64_t n = 0; n < num_rows; n++) {
+        auto row = x + n * num_columns;
+        auto max_value = juce::FloatVectorOperations::findMaximum(row, num_columns);
+        float sum = 0.0f;
+        for (int i = 0; i < num_columns; i++) {
+            row[i] = std::exp(row[i] - max_value);
+            sum += row[i];
+        }
+        juce::FloatVectorOperations::multiply(row, 1.0f / sum, num_columns);
+    }
+}
+
+// ============================================================================================================
+// ===          Layers
+// ============================================================================================================
+class Layer {
+public:
+    virtual ~Layer() = default;
+    // input is a contiguous float32 tensor
+    [[nodiscard]] virtual torch::Tensor forward(const torch::Tensor& input) const = 0;
+    [[nodiscard]] virtual size_t getMemoryUsageInBytes() const { return 0; }
+    [[nodiscard]] virtual std::string getName() const = 0;
+};
+
+// returns a contiguous float32 copy of the tensor, stored as [in, out] if transpose is true
+inline torch::Tensor prepare_weight(const std::map<std::string, torch::Tensor>& weights, const std::string& key,
+                                    bool transpose, bool required = true) {
+    auto it = weights.find(key);
+    if (it == weights.end()) {
+        if (required) { throw std::runtime_error("Native engine: missing weight " + key); }
+        return {};
+    }
+    auto weight = it->second.to(torch::kFloat32);
+    if (transpose) { weight = weight.t(); }
+    return weight.contiguous().clone();
+}
+
+class LinearLayer : public Layer {
+public:
+    LinearLayer(const std::map<std::string, torch::Tensor>& weights, const std::string& prefix) {
+        weight_t = prepare_weight(weights, prefix + ".weight", true);
+        bias = prepare_weight(weights, prefix + ".bias", false, false);
+        in_features = (int) weight_t.size(0);
+        out_features = (int) weight_t.size(1);
+    }
+
+    [[nodiscard]] torch::Tensor forward(const torch::Tensor& input) const override {
+        if (input.size(-1) != in_features) {
+            throw std::runtime_error("Native engine: linear expects " + std::to_string(in_features) +
+                                     " input features, got " + std::to_string(input.size(-1)));
+        }
+        auto output_shape = input.sizes().vec();
+        output_shape.back() = out_features;
+        auto output = torch::empty(output_shape, torch::kFloat32);
+        linear(input.data_ptr<float>(), output.data_ptr<float>(), input.numel() / in_features,
+               in_features, out_features, weight_t.data_ptr<float>(),
+               bias.defined() ? bias.data_ptr<float>() : nullptr);
+        return output;
+    }
+
+    [[nodiscard]] size_t getMemoryUsageInBytes() const override {
+        return weight_t.nbytes() + (bias.defined() ? bias.nbytes() : 0);
+    }
+
+    [[nodiscard]] std::string getName() const override {
+        return "linear(" + std::to_string(in_features) + " -> " + std::to_string(out_features) + ")";
+    }
+
+private:
+    torch::Tensor weight_t;
+    torch::Tensor bias;
+    int in_features{0};
+    int out_features{0};
+};
+
+class ActivationLayer : public Layer {
+public:
+    explicit ActivationLayer(std::string type_) : type(std::move(type_)) {
+        if (type != "relu" && type != "tanh" && type != "sigmoid" && type != "gelu" && type != "softmax") {
+            throw std::runtime_error("Native engine: unsupported layer type " + type);
+        }
+    }
+
+    [[nodiscard]] torch::Tensor forward(const torch::Tensor& input) const override {
+        auto output = input.clone();
+        auto data = output.data_ptr<float>();
+        auto num_elements = output.numel();
+        if (type == "relu") { relu(data, num_elements); }
+        else if (type == "tanh") { native_engine::tanh(data, num_elements); }
+        else if (type == "sigmoid") { sigmoid(data, num_elements); }
+        else if (type == "gelu") { gelu(data, num_elements); }
+        else if (num_elements > 0) {
+            auto num_columns = (int) output.size(-1);
+            softmax(data, num_elements / num_columns, num_columns);
+        }
+        return output;
+    }
+
+    [[nodiscard]] std::string getName() const override { return type; }
+
+private:
+    std::string type;
+};
+
+// gate order and equations follow torch.nn.GRU (r, z, n)
+class GRULayer : public Layer {
+public:
+    GRULayer(const std::map<std::string, torch::Tensor>& weights, const std::string& prefix, bool return_sequence_) :
+        return_sequence(return_sequence_) {
+        weight_ih_t = prepare_weight(weights, prefix + ".weight_ih_l0", true);
+        weight_hh_t = prepare_weight(weights, prefix + ".weight_hh_l0", true);
+        bias_ih = prepare_weight(weights, prefix + ".bias_ih_l0", false, false);
+        bias_hh = prepare_weight(weights, prefix + ".bias_hh_l0", false, false);
+        input_size = (int) weight_ih_t.size(0);
+        hidden_size = (int) weight_hh_t.size(0);
+    }
+
+    [[nodiscard]] torch::Tensor forward(const torch::Tensor& input) const override {
+        if (input.dim() != 3 || input.size(2) != input_size) {
+            throw std::runtime_error("Native engine: gru expects [batch, time, " + std::to_string(input_size) + "]");
+        }
+        auto batch = input.size(0);
+        auto time = input.size(1);
+        auto H = hidden_size;
+
+        // input projections for all time steps at once: [batch * time, 3H]
+        auto gates_x = torch::empty({batch, time, 3 * H}, torch::kFloat32);
+        linear(input.data_ptr<float>(), gates_x.data_ptr<float>(), batch * time, input_size, 3 * H,
+               weight_ih_t.data_ptr<float>(), bias_ih.defined() ? bias_ih.data_ptr<float>() : nullptr);
+
+        auto output = torch::empty({batch, return_sequence ? time : 1, H}, torch::kFloat32);
+        std::vector<float> h((size_t) H), gates_h((size_t) 3 * H);
+
+        for (int64_t b = 0; b < batch; b++) {
+            std::fill(h.begin(), h.end(), 0.0f);
+            for (int64_t t = 0; t < time; t++) {
+                linear(h.data(), gates_h.data(), 1, H, 3 * H, weight_hh_t.data_ptr<float>(),
+                       bias_hh.defined() ? bias_hh.data_ptr<float>() : nullptr);
+                auto gx = gates_x.data_ptr<float>() + (b * time + t) * 3 * H;
+                for (int i = 0; i < H; i++) {
+                    auto r = sigmoid(gx[i] + gates_h[(size_t) i]);
+                    auto z = sigmoid(gx[H + i] + gates_h[(size_t) (H + i)]);
+                    auto n = std::tanh(gx[2 * H + i] + r * gates_h[(size_t) (2 * H + i)]);
+                    h[(size_t) i] = (1.0f - z) * n + z * h[(size_t) i];
+                }
+                if (return_sequence || t == time - 1) {
+                    auto out_t = return_sequence ? t : 0;
+                    std::copy(h.begin(), h.end(), output.data_ptr<float>() + (b * output.size(1) + out_t) * H);
+                }
+            }
+        }
+        return return_sequence ? output : output.squeeze(1);
+    }
+
+    [[nodiscard]] size_t getMemoryUsageInBytes() const override {
+        size_t num_bytes = weight_ih_t.nbytes() + weight_hh_t.nbytes();
+        if (bias_ih.defined()) { num_bytes += bias_ih.nbytes(); }
+        if (bias_hh.defined()) { num_bytes += bias_hh.nbytes(); }
+        return num_bytes;
+    }
+
+    [[nodiscard]] std::string getName() const override {
+        return "gru(" + std::to_string(input_size) + " -> " + std::to_string(hidden_size) + ")";
+    }
+
+private:
+    torch::Tensor weight_ih_t, weight_hh_t, bias_ih, bias_hh;
+    int input_size{0};
+    int hidden_size{0};
+    bool return_sequence{true};
+};
+
+} // namespace native_engine
+
+// ============================================================================================================
+// ===          Backend
+// ============================================================================================================
+class NativeBackend : public InferenceBackend {
+public:
+    // throws std::runtime_error if the spec or weights are invalid
+    explicit NativeBackend(const std::string& spec_path) {
+        std::ifstream spec_file(spec_path);
+        if (!spec_file.good()) { throw std::runtime_error("Native engine: spec not found at " + spec_path); }
+        auto spec = native_engine::json::parse(spec_file);
+
+        auto directory = std::filesystem::path(spec_path).parent_path();
+        auto default_weights = std::filesystem::path(spec_path).replace_extension(".weights").filename();
+        auto weights_path = directory / spec.value("weights", default_weights.string());
+        auto weights = load_tensor_map_from_path(weights_path.string());
+
+        for (const auto& layer_json : spec.at("layers")) {
+            auto type = layer_json.at("type").get<std::string>();
+            if (type == "linear") {
+                layers.push_back(std::make_unique<native_engine::LinearLayer>(
+                    weights, layer_json.at("prefix").get<std::string>()));
+            } else if (type == "gru") {
+                layers.push_back(std::make_unique<native_engine::GRULayer>(
+                    weights, layer_json.at("prefix").get<std::string>(),
+                    layer_json.value("return", "sequence") == "sequence"));
+            } else {
+                layers.push_back(std::make_unique<native_engine::ActivationLayer>(type));
+            }
+        }
+    }
+
+    [[nodiscard]] std::string getName() const override { return "native"; }
+
+    torch::jit::IValue forward(const std::vector<torch::jit::IValue>& inputs) override {
+        if (inputs.empty() || !inputs[0].isTensor()) {
+            throw std::runtime_error("Native engine: forward() expects a tensor as the first input");
+        }
+        auto x = inputs[0].toTensor().to(torch::kFloat32).contiguous();
+        for (const auto& layer : layers) {
+            throwIfCancelled();
+            x = layer->forward(x);
+        }
+        return x;
+    }
+
+    [[nodiscard]] size_t getMemoryUsageInBytes() const override {
+        size_t num_bytes = 0;
+        for (const auto& layer : layers) { num_bytes += layer->getMemoryUsageInBytes(); }
+        return num_bytes;
+    }
+
+    [[nodiscard]] std::string getDescription() const {
+        std::stringstream ss;
+        ss << "Native engine | " << layers.size() << " layers | weights: "
+           << double(getMemoryUsageInBytes()) / 1024.0 << " KB |";
+        for (const auto& layer : layers) { ss << " " << layer->getName(); }
+        return ss.str();
+    }
+
+private:
+    std::vector<std::unique_ptr<native_engine::Layer>> layers;
+};
+
+// drums.pt --> drums.native.json
+inline std::string get_native_spec_path(const std::string& model_path) {
+    return std::filesystem::path(model_path).replace_extension(".native.json").string();
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "shared_plugin_helpers/shared_plugin_helpers.h"
+#include <torch/script.h> // One-stop header.
+
+#if JUCE_INTEL
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// ============================================================================================================
+// ===          CPU Support
+// ============================================================================================================
+// true if the cpu has native bf16 dot products (AVX512_BF16 or AMX-BF16). Without them
+// libtorch emulates bf16 with fp32 conversions, which is usually slower than plain fp32.
+inline bool cpu_supports_native_bf16() {
+#if JUCE_INTEL
+    static const bool is_supported = [] {
+        if (!juce::SystemStats::hasAVX512F()) { return false; } // both extensions require AVX-512
+
+        unsigned int eax{0}, ebx{0}, ecx{0}, edx{0};
+#if defined(_MSC_VER)
+        int regs[4];
+        __cpuid(regs, 0);
+        if (regs[0] < 7) { return false; }
+        __cpuidex(regs, 7, 0);
+        edx = (unsigned int) regs[3];
+        auto amx_bf16 = (edx >> 22) & 1u;
+        __cpuidex(regs, 7, 1);
+        eax = (unsigned int) regs[0];
+#else
+        if (__get_cpuid_max(0, nullptr) < 7) { return false; }
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        auto amx_bf16 = (edx >> 22) & 1u;
+        __cpuid_count(7, 1, eax, ebx, ecx, edx);
+#endif
+        auto avx512_bf16 = (eax >> 5) & 1u;
+        return avx512_bf16 != 0 || amx_bf16 != 0;
+    }();
+    return is_supported;
+#else
+    return false;
+#endif
+}
+
+// ============================================================================================================
+// ===          Dtype Helpers
+// ============================================================================================================
+// dtype of the first floating point parameter/buffer (float32 if the module has none)
+inline torch::ScalarType get_module_floating_dtype(const torch::jit::script::Module& module) {
+    for (const auto& attribute : module.named_attributes(/*recurse=*/true)) {
+        if (attribute.value.isTensor() && attribute.value.toTensor().is_floating_point()) {
+            return attribute.value.toTensor().scalar_type();
+        }
+    }
+    return torch::kFloat32;
+}
+
+// casts floating point tensors (also inside tuples/lists) to dtype, everything else is returned as is
+inline torch::jit::IValue cast_floating_tensors(const torch::jit::IValue& value, torch::ScalarType dtype) {
+    if (value.isTensor()) {
+        const auto& tensor = value.toTensor();
+        return tensor.is_floating_point() && tensor.scalar_type() != dtype ? tensor.to(dtype) : tensor;
+    }
+    if (value.isTuple()) {
+        std::vector<torch::jit::IValue> elements;
+        for (const auto& element : value.toTupleRef().elements()) {
+            elements.push_back(cast_floating_tensors(element, dtype));
+        }
+        return c10::ivalue::Tuple::create(std::move(elements));
+    }
+    if (value.isTensorList()) {
+        auto list = value.toTensorList();
+        c10::List<torch::Tensor> casted;
+        for (const torch::Tensor& tensor : list) {
+            casted.push_back(tensor.is_floating_point() ? tensor.to(dtype) : tensor);
+        }
+        return casted;
+    }
+    return value;
+}
+
+inline std::vector<torch::jit::IValue> cast_floating_tensors(const std::vector<torch::jit::IValue>& values,
+                                                             torch::ScalarType dtype) {
+    std::vector<torch::jit::IValue> casted;
+    casted.reserve(values.size());
+    for (const auto& value : values) { casted.push_back(cast_floating_tensors(value, dtype)); }
+    return casted;
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <torch/script.h> // One-stop header.
+#include "../Includes/Configs_Parser.h"
+#include "InferenceCache.h"
+#include "ModelLoader.h"
+#include "TorchThreading.h"
+
+#include <filesystem>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+/*
+ * A prepared (frozen/optimized/warmed up) model that can be shared by all plugin instances
+ * in the process. The module is only used for forward() calls, which are safe to run from
+ * several DPL threads at the same time. Everything that changes during inference (workspace,
+ * cache, playback data, ...) stays in the DeploymentThread of each instance.
+ */
+struct SharedModel {
+    std::string model_path;
+    torch::jit::script::Module module;
+    torch::ScalarType floating_dtype{torch::kFloat32};
+};
+
+/*
+ * Process-wide registry of loaded models, keyed by model path + file size + modification
+ * time + preparation settings (so a re-exported file is loaded again, without reading the
+ * file on every lookup). Entries are reference counted: the model is released as soon as the
+ * last instance using it drops its handle (e.g. loads another model or is destroyed).
+ *
+ * If several instances request the same model at the same time, only the first one loads it
+ * and the others wait for the result.
+ */
+class SharedModelRegistry {
+public:
+    static SharedModelRegistry& instance() {
+        static SharedModelRegistry registry;
+        return registry;
+    }
+
+    // throws (same as load_and_prepare_model) if the model can't be loaded
+    std::shared_ptr<const SharedModel> acquire(const std::string& model_path, const std::string& model_name) {
+        auto settings_json = get_model_loading_json(model_name);
+        auto key = makeKey(model_path, settings_json.dump());
+
+        std::promise<std::shared_ptr<const SharedModel>> promise;
+        std::shared_future<std::shared_ptr<const SharedModel>> in_flight;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pruneExpiredEntries();
+            if (auto it = entries.find(key); it != entries.end()) {
+                if (auto existing = it->second.lock()) {
+                    num_shared_loads++;
+                    return existing;
+                }
+            }
+            if (auto it = loading.find(key); it != loading.end()) {
+                in_flight = it->second;
+            } else {
+                loading[key] = promise.get_future().share();
+            }
+        }
+
+        // another instance is already loading the same model
+        if (in_flight.valid()) {
+            auto model = in_flight.get();
+            std::lock_guard<std::mutex> lock(mutex);
+            num_shared_loads++;
+            return model;
+        }
+
+        try {
+            auto model = std::make_shared<SharedModel>();
+            model->model_path = model_path;
+            model->module = load_and_prepare_model(model_path, ModelLoadSettings::fromJson(settings_json),
+                                                   &model->floating_dtype);
+            benchmark_torch_thread_counts_if_enabled(model->module, model_path, model_name, model->floating_dtype);
+
+            std::shared_ptr<const SharedModel> shared = model;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                entries[key] = shared;
+                loading.erase(key);
+                num_loads++;
+            }
+            promise.set_value(shared);
+            return shared;
+        } catch (...) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                loading.erase(key);
+            }
+            promise.set_exception(std::current_exception());
+            throw;
+        }
+    }
+
+    [[nodiscard]] std::string getDescription() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::stringstream ss;
+        ss << "Shared Model Registry | loads: " << num_loads << " | shared: " << num_shared_loads;
+        for (const auto& [key, entry] : entries) {
+            if (auto model = entry.lock()) {
+                // one reference is held by the local variable above
+                ss << std::endl << "    " << model->model_path << " | instances: " << model.use_count() - 1;
+            }
+        }
+        return ss.str();
+    }
+
+private:
+    SharedModelRegistry() = default;
+
+    std::mutex mutex;
+    std::map<std::string, std::weak_ptr<const SharedModel>> entries;
+    std::map<std::string, std::shared_future<std::shared_ptr<const SharedModel>>> loading;
+    int64_t num_loads{0};
+    int64_t num_shared_loads{0};
+
+    // entries whose model was released by all instances
+    void pruneExpiredEntries() {
+        for (auto it = entries.begin(); it != entries.end();) {
+            it = it->second.expired() ? entries.erase(it) : std::next(it);
+        }
+    }
+
+    static std::string makeKey(const std::string& model_path, const std::string& settings) {
+        std::error_code ec;
+        auto file_size = std::filesystem::file_size(model_path, ec);
+        if (ec) { file_size = 0; }
+        auto mtime = std::filesystem::last_write_time(model_path, ec);
+        auto mtime_ticks = ec ? 0 : (int64_t) mtime.time_since_epoch().count();
+        auto settings_hash = InferenceCache::hashBytes(settings.data(), settings.size(), 0);
+
+        std::stringstream ss;
+        ss << model_path << "|" << file_size << "|" << mtime_ticks << "|" << std::hex << settings_hash;
+        return ss.str();
+    }
+};
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <torch/script.h> // One-stop header.
+#include "../Includes/InputEvent.h"
+
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <optional>
+#include <sstream>
+
+/*
+ * Keeps track of a single speculative generation started ahead of the next bar.
+ *
+ * The DPL thread polls the playhead (RealTimePlaybackInfo) and, as soon as the next bar
+ * start is closer than the lookahead window, asks the user code for a job that generates
+ * that bar (see DeploymentThread::prepareSpeculativeBarJob). When the NewBarEvent arrives,
+ * deploy() claims the result using DeploymentThread::takeSpeculativeResult().
+ *
+ * Any input that changes the generation context (notes, gui params, presets,
+ * stop/restart of playback) invalidates the pending speculation. A new one is started on
+ * the next iteration if the bar hasn't started yet, so the result is effectively patched
+ * with the latest context.
+ *
+ * The playhead is shared with the audio thread, which skips its update whenever the DPL thread
+ * holds the lock. So it is only read when, extrapolated from the last reading, a bar start could
+ * be within the lookahead window (or the last reading is older than kMaxPlayheadAgeMs).
+ *
+ * hits    --> the result for the bar was available and still valid when the bar started
+ * late    --> hit, but inference hadn't finished yet (consider a larger lookahead)
+ * misses  --> no valid speculation existed for the bar
+ */
+class SpeculativeBarScheduler {
+public:
+    SpeculativeBarScheduler() = default;
+
+    using clock = std::chrono::steady_clock;
+
+    explicit SpeculativeBarScheduler(double lookahead_ms_) : lookahead_ms(lookahead_ms_) {}
+
+    [[nodiscard]] bool shouldReadPlayhead(clock::time_point now) const {
+        if (!last_playhead.has_value()) { return true; }
+        auto age_ms = std::chrono::duration<double, std::milli>(now - last_playhead_read_at).count();
+        if (age_ms >= kMaxPlayheadAgeMs) { return true; }
+
+        const auto& playhead = *last_playhead;
+        if (!playhead.isPlaying || playhead.qpm <= 0 || playhead.numerator <= 0 || playhead.denominator <= 0) {
+            return false;
+        }
+        auto predicted_ppq = playhead.time_in_ppq + age_ms / 60000.0 * playhead.qpm;
+        auto next_bar_start_ppq = playhead.nextBarStartInQuarterNotes(predicted_ppq);
+        if (pending && pending->is_valid && isSameBar(pending->bar_start_ppq, next_bar_start_ppq)) { return false; }
+        return (next_bar_start_ppq - predicted_ppq) * 60000.0 / playhead.qpm <= lookahead_ms;
+    }
+
+    void setPlayhead(const BufferMetaData &playhead, clock::time_point now) {
+        last_playhead = playhead;
+        last_playhead_read_at = now;
+    }
+
+    // returns the ppq of the upcoming bar start if it falls within the lookahead window
+    // and no valid speculation has been started for it yet
+    [[nodiscard]] std::optional<double> getBarToSpeculate(const BufferMetaData &now) const {
+        if (!now.isPlaying || now.qpm <= 0 || now.numerator <= 0 || now.denominator <= 0) {
+            return std::nullopt;
+        }
+
+        auto next_bar_start_ppq = now.nextBarStartInQuarterNotes(now.time_in_ppq);
+
+        auto lookahead_ppq = lookahead_ms / 1000.0 * now.qpm / 60.0;
+        if (next_bar_start_ppq - now.time_in_ppq > lookahead_ppq) { return std::nullopt; }
+
+        if (pending && pending->is_valid && isSameBar(pending->bar_start_ppq, next_bar_start_ppq)) {
+            return std::nullopt;
+        }
+
+        return next_bar_start_ppq;
+    }
+
+    void launch(double bar_start_ppq, std::future<torch::jit::IValue> future) {
+        if (pending && pending->is_valid && !pending->is_claimed) { num_discarded++; }
+        pending = Speculation{bar_start_ppq, std::move(future), true, false};
+        num_launched++;
+    }
+
+    // called when new input makes the pending result obsolete (also forces a new playhead reading,
+    // the input may be a relocation or a tempo change)
+    void invalidate() {
+        last_playhead.reset();
+        if (pending && pending->is_valid) {
+            pending->is_valid = false;
+            num_invalidated++;
+        }
+    }
+
+    // claims the result for the bar starting at bar_start_ppq, blocks if inference is still running
+    std::optional<torch::jit::IValue> take(double bar_start_ppq) {
+        if (!pending || !pending->is_valid || pending->is_claimed ||
+            !isSameBar(pending->bar_start_ppq, bar_start_ppq)) {
+            num_misses++;
+            return std::nullopt;
+        }
+
+        pending->is_claimed = true;
+
+        auto is_ready = pending->future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        if (!is_ready) { num_late_hits++; }
+
+        try {
+            auto result = pending->future.get();
+            num_hits++;
+            return result;
+        } catch (const std::exception &e) {
+            std::cout << "[DPL] Speculative generation failed: " << e.what() << std::endl;
+            num_misses++;
+            return std::nullopt;
+        }
+    }
+
+    void setLookaheadMs(double lookahead_ms_) { lookahead_ms = lookahead_ms_; }
+    [[nodiscard]] double getLookaheadMs() const { return lookahead_ms; }
+
+    [[nodiscard]] int64_t getNumHits() const { return num_hits; }
+    [[nodiscard]] int64_t getNumMisses() const { return num_misses; }
+    [[nodiscard]] double getHitRate() const {
+        auto total = num_hits + num_misses;
+        return total > 0 ? double(num_hits) / double(total) : 0.0;
+    }
+
+    [[nodiscard]] std::string getDescription() const {
+        std::stringstream ss;
+        ss << "Speculative Generation | lookahead: " << lookahead_ms << " ms";
+        ss << " | launched: " << num_launched;
+        ss << " | hits: " << num_hits << " (late: " << num_late_hits << ")";
+        ss << " | misses: " << num_misses;
+        ss << " | hit rate: " << getHitRate() * 100.0 << " %";
+        ss << " | invalidated: " << num_invalidated;
+        ss << " | discarded: " << num_discarded;
+        return ss.str();
+    }
+
+private:
+    struct Speculation {
+        double bar_start_ppq;
+        std::future<torch::jit::IValue> future;
+        bool is_valid;
+        bool is_claimed;
+    };
+
+    static constexpr double kMaxPlayheadAgeMs{100};
+
+    double lookahead_ms{250};
+    std::optional<Speculation> pending;
+    std::optional<BufferMetaData> last_playhead;
+    clock::time_point last_playhead_read_at;
+
+    int64_t num_launched{0};
+    int64_t num_hits{0};
+    int64_t num_late_hits{0};
+    int64_t num_misses{0};
+    int64_t num_invalidated{0};
+    int64_t num_discarded{0};
+
+    static bool isSameBar(double ppq_a, double ppq_b) { return std::abs(ppq_a - ppq_b) < 1e-3; }
+};
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <torch/script.h> // One-stop header.
+#include <c10/core/CPUAllocator.h>
+#include <c10/core/InferenceMode.h>
+#include <c10/core/impl/alloc_cpu.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <sstream>
+
+/*
+ * Bump allocator for the temporary CPU tensors created during a deploy() call.
+ *
+ * While a TensorArena::Scope is active on a thread, CPU tensor allocations made by that
+ * thread are carved out of one preallocated block instead of going through the general
+ * purpose allocator. reset() (called by the DPL thread after every deploy()) rewinds the
+ * block. Allocations from other threads, and the ones that don't fit into the remaining
+ * space, fall back to the regular CPU allocator.
+ *
+ * Tensors that outlive the call (kept in modelState, the inference cache, ...) keep their
+ * block alive: on reset() the block is retired (freed once the last of its tensors is
+ * released) and a new block is allocated. Allocate long-lived tensors inside a
+ * TensorArena::Suspend scope to avoid this (TensorWorkspace, KVCache and InferenceCache
+ * already do, ModelState::set() copies the stored values out of the arena).
+ */
+class TensorArena {
+public:
+    static constexpr size_t kAlignment{64};
+
+    explicit TensorArena(size_t capacity_bytes_) : capacity_bytes(alignUp(std::max<size_t>(capacity_bytes_, 1))) {
+        installAllocator();
+        block = Block::create(capacity_bytes);
+    }
+
+    ~TensorArena() {
+        if (block != nullptr) { block->release(); }
+    }
+
+    TensorArena(const TensorArena&) = delete;
+    TensorArena& operator=(const TensorArena&) = delete;
+
+    // routes the CPU allocations of the calling thread into the arena while alive
+    class Scope {
+    public:
+        explicit Scope(TensorArena* arena) : previous(active_arena()) { active_arena() = arena; }
+        ~Scope() { active_arena() = previous; }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        TensorArena* previous;
+    };
+
+    // allocations made while alive use the regular CPU allocator (for tensors kept across calls)
+    class Suspend : public Scope {
+    public:
+        Suspend() : Scope(nullptr) {}
+    };
+
+    // true if allocations of the calling thread currently go to an arena
+    [[nodiscard]] static bool isActiveOnThisThread() { return active_arena() != nullptr; }
+
+    // copies the tensors of value (tensor, tuple or tensor list) to regular CPU memory, so that
+    // keeping them across deploy() calls doesn't retire the block they were allocated in
+    static torch::jit::IValue copyOut(const torch::jit::IValue& value) {
+        Suspend persistent;
+        if (value.isTensor()) {
+            const auto& tensor = value.toTensor();
+            return tensor.defined() && tensor.is_cpu() ? tensor.clone() : tensor;
+        }
+        if (value.isTuple()) {
+            std::vector<torch::jit::IValue> elements;
+            for (const auto& element : value.toTupleRef().elements()) { elements.push_back(copyOut(element)); }
+            return c10::ivalue::Tuple::create(std::move(elements));
+        }
+        if (value.isTensorList()) {
+            c10::List<torch::Tensor> copied;
+            for (const torch::Tensor& tensor : value.toTensorList()) {
+                copied.push_back(tensor.defined() && tensor.is_cpu() ? tensor.clone() : tensor);
+            }
+            return copied;
+        }
+        return value;
+    }
+
+    // rewinds the arena, must be called on the thread that uses it and outside any Scope
+    void reset() {
+        num_resets++;
+        if (block->num_references.load(std::memory_order_acquire) == 1) {
+            block->offset = 0;
+            return;
+        }
+        // some tensors escaped the call, their memory stays valid until they are released
+        num_retired_blocks++;
+        block->release();
+        block = Block::create(capacity_bytes);
+    }
+
+    [[nodiscard]] size_t getCapacityInBytes() const { return capacity_bytes; }
+    [[nodiscard]] size_t getPeakUsageInBytes() const { return peak_usage_bytes.load(std::memory_order_relaxed); }
+    [[nodiscard]] int64_t getNumArenaAllocations() const { return num_arena_allocations.load(std::memory_order_relaxed); }
+    [[nodiscard]] int64_t getNumFallbackAllocations() const { return num_fallback_allocations.load(std::memory_order_relaxed); }
+    [[nodiscard]] size_t getFallbackBytes() const { return fallback_bytes.load(std::memory_order_relaxed); }
+    [[nodiscard]] int64_t getNumRetiredBlocks() const { return num_retired_blocks; }
+
+    [[nodiscard]] std::string getDescription() const {
+        std::stringstream ss;
+        ss << "Tensor Arena | capacity: " << double(capacity_bytes) / (1024.0 * 1024.0) << " MB"
+           << " | peak: " << double(getPeakUsageInBytes()) / (1024.0 * 1024.0) << " MB"
+           << " | allocations: " << getNumArenaAllocations()
+           << " | fallbacks: " << getNumFallbackAllocations() << " (" << double(getFallbackBytes()) / 1024.0 << " KB)"
+           << " | resets: " << num_resets << " | retired blocks: " << num_retired_blocks;
+        return ss.str();
+    }
+
+private:
+    struct Block {
+        char* data{nullptr};
+        size_t capacity{0};
+        size_t offset{0};
+        // one reference held by the arena + one per live allocation
+        std::atomic<int64_t> num_references{1};
+
+        static Block* create(size_t capacity) {
+            auto* block = new Block();
+            block->data = static_cast<char*>(c10::alloc_cpu(capacity));
+            block->capacity = capacity;
+            return block;
+        }
+
+        void release() {
+            if (num_references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                c10::free_cpu(data);
+                delete this;
+            }
+        }
+
+        static void deleter(void* ctx) { static_cast<Block*>(ctx)->release(); }
+    };
+
+    // forwards to the allocator that was installed before, unless an arena is active on the calling thread
+    class Allocator : public c10::Allocator {
+    public:
+        explicit Allocator(c10::Allocator* fallback_) : fallback(fallback_) {}
+
+        c10::DataPtr allocate(size_t num_bytes) const override {
+            auto* arena = active_arena();
+            if (arena == nullptr || num_bytes == 0) { return fallback->allocate(num_bytes); }
+            if (auto data_ptr = arena->tryAllocate(num_bytes)) { return std::move(*data_ptr); }
+            arena->num_fallback_allocations.fetch_add(1, std::memory_order_relaxed);
+            arena->fallback_bytes.fetch_add(num_bytes, std::memory_order_relaxed);
+            return fallback->allocate(num_bytes);
+        }
+
+    private:
+        c10::Allocator* fallback;
+    };
+
+    size_t capacity_bytes;
+    Block* block{nullptr};
+    std::atomic<size_t> peak_usage_bytes{0};
+    std::atomic<int64_t> num_arena_allocations{0};
+    std::atomic<int64_t> num_fallback_allocations{0};
+    std::atomic<size_t> fallback_bytes{0};
+    int64_t num_resets{0};
+    int64_t num_retired_blocks{0};
+
+    static size_t alignUp(size_t num_bytes) { return (num_bytes + kAlignment - 1) / kAlignment * kAlignment; }
+
+    static TensorArena*& active_arena() {
+        thread_local TensorArena* arena{nullptr};
+        return arena;
+    }
+
+    // the CPU allocator is process wide, so it is replaced once and checks the calling thread's arena
+    static void installAllocator() {
+        static std::once_flag flag;
+        std::call_once(flag, [] {
+            static Allocator allocator(c10::GetCPUAllocator());
+            c10::SetCPUAllocator(&allocator, /*priority=*/std::numeric_limits<uint8_t>::max());
+        });
+    }
+
+    std::optional<c10::DataPtr> tryAllocate(size_t num_bytes) {
+        auto size = alignUp(num_bytes);
+        if (block->offset + size > block->capacity) { return std::nullopt; }
+
+        void* data = block->data + block->offset;
+        block->offset += size;
+        block->num_references.fetch_add(1, std::memory_order_relaxed);
+        num_arena_allocations.fetch_add(1, std::memory_order_relaxed);
+        if (block->offset > peak_usage_bytes.load(std::memory_order_relaxed)) {
+            peak_usage_bytes.store(block->offset, std::memory_order_relaxed);
+        }
+        return c10::DataPtr(data, block, &Block::deleter, c10::Device(c10::DeviceType::CPU));
+    }
+};
+
+/*
+ * Entered by the DPL thread around every deploy() call (see deployment_settings.execution_context):
+ * torch::InferenceMode (no autograd bookkeeping, no version counters) and, if enabled, the
+ * tensor arena. The arena is rewound when the context is destroyed.
+ */
+class InferenceExecutionContext {
+public:
+    InferenceExecutionContext(bool inference_mode, TensorArena* arena_) : arena(arena_) {
+        if (inference_mode) { guard.emplace(); }
+        if (arena != nullptr) { scope.emplace(arena); }
+    }
+
+    ~InferenceExecutionContext() {
+        scope.reset();
+        if (arena != nullptr) { arena->reset(); }
+    }
+
+    InferenceExecutionContext(const InferenceExecutionContext&) = delete;
+    InferenceExecutionContext& operator=(const InferenceExecutionContext&) = delete;
+
+private:
+    TensorArena* arena;
+    std::optional<c10::InferenceMode> guard;
+    std::optional<TensorArena::Scope> scope;
+};
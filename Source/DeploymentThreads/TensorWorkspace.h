@@ -0,0 +1,121 @@
+#pragma once
+
+#include <torch/script.h> // One-stop header.
+#include "TensorArena.h"
+
+#include <map>
+#include <optional>
+#include <sstream>
+#include <unordered_map>
+
+/*
+ * Named, preallocated tensors that are reused across deploy() calls.
+ *
+ * Declare the buffers once (e.g. in DeploymentThread::onModelInstalled()), then fill them
+ * in place from the event data and pass them to the model without allocating new tensors:
+ *
+ *      // once
+ *      workspace.declare("notes", {1, 32, 27});
+ *      workspace.declare("mask", {1, 32}, torch::kBool);
+ *
+ *      // every call
+ *      auto& notes = workspace.get("notes");
+ *      notes.zero_();
+ *      notes[0][step][pitch] = velocity;
+ *      auto output = forward(workspace.inputs({"notes", "mask"}));
+ *
+ * declare() is a no-op if a buffer with the same name, shape and dtype already exists,
+ * so it is safe to call it repeatedly.
+ */
+class TensorWorkspace {
+public:
+    TensorWorkspace() = default;
+
+    torch::Tensor& declare(const std::string& name, at::IntArrayRef shape,
+                           torch::ScalarType dtype = torch::kFloat32) {
+        if (c10::isFloatingType(dtype)) { dtype = floating_dtype.value_or(dtype); }
+        auto it = buffers.find(name);
+        if (it != buffers.end() && it->second.sizes() == shape && it->second.scalar_type() == dtype) {
+            return it->second;
+        }
+
+        if (it != buffers.end()) { num_reallocations++; }
+        TensorArena::Suspend persistent; // the buffers outlive the deploy() call
+        buffers[name] = torch::zeros(shape, torch::TensorOptions().dtype(dtype));
+        cached_inputs.clear(); // IValues may refer to the replaced tensor
+        return buffers[name];
+    }
+
+    [[nodiscard]] bool has(const std::string& name) const { return buffers.find(name) != buffers.end(); }
+
+    // throws std::out_of_range if the buffer wasn't declared
+    torch::Tensor& get(const std::string& name) { return buffers.at(name); }
+
+    // copies the content of a tensor into a declared buffer (shapes must be broadcastable)
+    torch::Tensor& copyInto(const std::string& name, const torch::Tensor& source) {
+        auto& buffer = get(name);
+        buffer.copy_(source);
+        return buffer;
+    }
+
+    void zero(const std::string& name) { get(name).zero_(); }
+
+    void zeroAll() {
+        for (auto& [name, buffer] : buffers) { buffer.zero_(); }
+    }
+
+    // returns a (cached) list of IValues referring to the buffers, ready to be passed to forward()
+    const std::vector<torch::jit::IValue>& inputs(const std::vector<std::string>& names) {
+        std::string key;
+        for (const auto& name : names) { key += name + '\n'; }
+
+        auto it = cached_inputs.find(key);
+        if (it != cached_inputs.end()) { return it->second; }
+
+        std::vector<torch::jit::IValue> values;
+        values.reserve(names.size());
+        for (const auto& name : names) { values.emplace_back(get(name)); }
+        return cached_inputs.emplace(key, std::move(values)).first->second;
+    }
+
+    // converts all floating point buffers to the given dtype (e.g. to match a reduced precision model)
+    // floating point buffers declared afterwards are also allocated in this dtype
+    void convertFloatingBuffersTo(torch::ScalarType dtype) {
+        floating_dtype = dtype;
+        for (auto& [name, buffer] : buffers) {
+            if (buffer.is_floating_point() && buffer.scalar_type() != dtype) {
+                buffer = buffer.to(dtype);
+            }
+        }
+        cached_inputs.clear();
+    }
+
+    void clear() {
+        buffers.clear();
+        cached_inputs.clear();
+    }
+
+    [[nodiscard]] size_t getMemoryUsageInBytes() const {
+        size_t num_bytes = 0;
+        for (const auto& [name, buffer] : buffers) { num_bytes += buffer.nbytes(); }
+        return num_bytes;
+    }
+
+    [[nodiscard]] std::string getDescription() const {
+        std::stringstream ss;
+        ss << "Tensor Workspace | buffers: " << buffers.size();
+        ss << " | memory: " << double(getMemoryUsageInBytes()) / 1024.0 << " KB";
+        ss << " | reallocations: " << num_reallocations;
+        for (const auto& [name, buffer] : buffers) {
+            ss << std::endl << "    " << name << " | " << buffer.sizes() << " | " << buffer.scalar_type()
+               << " | " << double(buffer.nbytes()) / 1024.0 << " KB";
+        }
+        return ss.str();
+    }
+
+private:
+    std::map<std::string, torch::Tensor> buffers;
+    std::unordered_map<std::string, std::vector<torch::jit::IValue>> cached_inputs;
+    int64_t num_reallocations{0};
+    std::optional<torch::ScalarType> floating_dtype;
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "shared_plugin_helpers/shared_plugin_helpers.h"
+#include <torch/script.h> // One-stop header.
+#include <ATen/Parallel.h>
+#include "../Includes/Configs_Parser.h"
+#include "../Includes/colored_cout.h"
+#include "../Includes/ThreadScheduling.h"
+#include "ModelLoader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+
+// ============================================================================================================
+// ===          Intra-op / Inter-op Thread Configuration
+// ============================================================================================================
+/*
+ * Applies deployment_settings.torch_threading. Must be called on the DPL thread before the
+ * first inference.
+ *
+ * share_process_wide_pool = true  --> the thread counts are applied once per process, all plugin
+ *                                     instances share the same torch pool
+ * share_process_wide_pool = false --> every DPL thread sets the intra-op thread count for itself
+ *                                     (with OpenMP builds of libtorch the count is per calling thread)
+ *
+ * The number of inter-op threads can only be set once per process and before any inter-op
+ * work has started, so it is always applied process wide.
+ */
+inline void configure_torch_threading() {
+    using namespace deployment_settings::TorchThreading;
+
+    static std::once_flag interop_flag;
+    std::call_once(interop_flag, [] {
+        if (inter_op_threads <= 0) { return; }
+        try {
+            at::set_num_interop_threads(inter_op_threads);
+        } catch (const std::exception& e) {
+            std::cout << clr::yellow << "[DPL] Couldn't set inter-op threads: " << e.what() << std::endl;
+        }
+    });
+
+    auto apply_intra_op_threads = [] {
+        if (intra_op_threads > 0) { at::set_num_threads(intra_op_threads); }
+    };
+
+    if (share_process_wide_pool) {
+        static std::once_flag intra_op_flag;
+        std::call_once(intra_op_flag, apply_intra_op_threads);
+    } else {
+        apply_intra_op_threads();
+    }
+
+    std::cout << clr::green << "[DPL] torch threads | intra-op: " << at::get_num_threads()
+              << " | inter-op: " << at::get_num_interop_threads()
+              << " | shared pool: " << (share_process_wide_pool ? "yes" : "no") << std::endl;
+}
+
+// ============================================================================================================
+// ===          Benchmark
+// ============================================================================================================
+// Measures forward() latency for 1..max_threads intra-op threads and prints median/p95 per
+// count. The previous thread count is restored afterwards, also if forward() throws.
+inline void benchmark_torch_thread_counts(torch::jit::script::Module& model,
+                                          const std::vector<torch::jit::IValue>& inputs,
+                                          int max_threads, int iterations) {
+    if (inputs.empty()) {
+        std::cout << clr::yellow << "[DPL] Thread benchmark skipped, no warm-up inputs declared" << std::endl;
+        return;
+    }
+
+    struct RestoreNumThreads {
+        int num_threads;
+        ~RestoreNumThreads() { at::set_num_threads(num_threads); }
+    } restore{at::get_num_threads()};
+
+    if (max_threads <= 0) { max_threads = (int) std::max(1u, std::thread::hardware_concurrency()); }
+    iterations = std::max(1, iterations);
+
+    at::NoGradGuard no_grad;
+    std::cout << clr::green << "[DPL] Benchmarking inference latency vs. intra-op threads ("
+              << iterations << " iterations each)" << std::endl;
+
+    try {
+        for (int num_threads = 1; num_threads <= max_threads; num_threads++) {
+            at::set_num_threads(num_threads);
+            model.forward(inputs); // exclude the first call after resizing the pool
+
+            std::vector<double> latencies_ms;
+            for (int i = 0; i < iterations; i++) {
+                auto start = std::chrono::steady_clock::now();
+                model.forward(inputs);
+                auto end = std::chrono::steady_clock::now();
+                latencies_ms.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+            }
+            std::sort(latencies_ms.begin(), latencies_ms.end());
+            auto median = latencies_ms[latencies_ms.size() / 2];
+            auto p95 = latencies_ms[std::min(latencies_ms.size() - 1, latencies_ms.size() * 95 / 100)];
+
+            std::cout << clr::green << "[DPL]     threads: " << num_threads << " | median: " << median
+                      << " ms | p95: " << p95 << " ms" << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cout << clr::yellow << "[DPL] Thread benchmark failed: " << e.what() << std::endl;
+    }
+}
+
+// Runs the benchmark if deployment_settings.torch_threading.benchmark_thread_counts is enabled.
+// Called once per loaded model (not on every swap/instance): on the background loader thread
+// when loading asynchronously, where the changed thread count also affects the model that is
+// still serving while the benchmark runs
+inline void benchmark_torch_thread_counts_if_enabled(torch::jit::script::Module& model, const std::string& model_path,
+                                                     const std::string& model_name,
+                                                     torch::ScalarType floating_dtype) {
+    using namespace deployment_settings::TorchThreading;
+    if (!benchmark_thread_counts) { return; }
+    benchmark_torch_thread_counts(
+        model, make_warmup_inputs(model_path, get_model_load_settings(model_name), floating_dtype),
+        benchmark_max_threads, benchmark_iterations);
+}
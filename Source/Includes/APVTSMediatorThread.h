@@ -7,6 +7,7 @@
 #include "shared_plugin_helpers/shared_plugin_helpers.h"
 #include "GuiParameters.h"
 #include "LockFreeQueue.h"
+#include "ThreadScheduling.h"
 #include <mutex>
 
 inline std::vector<juce::ParameterID> get_params_to_default() {
@@ -334,7 +335,7 @@ public:
         guiParamsPntr = make_unique<GuiParams>(APVTSPntr_);
         APVM2DPL_GuiParams_QuePntr->push(*guiParamsPntr);
 
-        startThread();
+        startThread(get_juce_thread_priority(get_thread_scheduling_settings("APVTSMediatorThread")));
     }
 
     // ------------------------------------------------------------------------------------------------------------
@@ -344,6 +345,8 @@ public:
     // ------------------------------------------------------------------------------------------------------------
     void run() override {
 
+        apply_thread_scheduling(get_thread_scheduling_settings("APVTSMediatorThread"), "[APVM]");
+
         // notify if the thread is still running
         bool bExit = threadShouldExit();
 
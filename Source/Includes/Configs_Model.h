@@ -25,3 +25,102 @@ namespace MDL_path {
 
 
 
+
+// ======================================================================================
+// ==================     Model Loading Settings             ============================
+// ======================================================================================
+// parses the dtype names used in settings.json (e.g. "float32", "int64")
+inline torch::ScalarType parse_scalar_type(const std::string& dtype) {
+    if (dtype == "float32" || dtype == "float") { return torch::kFloat32; }
+    if (dtype == "float64" || dtype == "double") { return torch::kFloat64; }
+    if (dtype == "float16" || dtype == "half") { return torch::kFloat16; }
+    if (dtype == "bfloat16") { return torch::kBFloat16; }
+    if (dtype == "int64" || dtype == "long") { return torch::kInt64; }
+    if (dtype == "int32" || dtype == "int") { return torch::kInt32; }
+    if (dtype == "bool") { return torch::kBool; }
+    std::cout << "Unknown dtype: " << dtype << " -- using float32 instead" << std::endl;
+    return torch::kFloat32;
+}
+
+struct WarmupInputSpec {
+    std::vector<int64_t> shape;
+    torch::ScalarType dtype{torch::kFloat32};
+};
+
+/*
+ * Options applied to a model when it is loaded (see deployment_settings.model_loading
+ * in settings.json):
+ *
+ *      "freeze"                    --> inlines parameters/attributes into the graph
+ *      "optimize_for_inference"    --> applies torch::jit::optimize_for_inference
+ *                                      (implies freezing)
+ *      "warmup_iterations"         --> number of forward passes run before the model is
+ *                                      marked as loaded
+ *      "warmup_inputs"             --> list of {"shape": [...], "dtype": "..."} used for the
+ *                                      warm-up forward passes. Alternatively, a tensor map
+ *                                      saved next to the model as <model_name>.warmup_inputs
+ *                                      (see save_tensor_map) is used if available
+ *      "quantization"              --> "none" or "dynamic_int8". For "dynamic_int8" the model is
+ *                                      replaced by <model_name>.dynamic_int8.pt if found next to
+ *                                      it (see get_quantized_model_path in ModelLoader.h)
+ *      "compare_with_fp32"         --> prints the accuracy/latency/memory difference between the
+ *                                      fp32 and the quantized model on the warm-up inputs
+ *      "comparison_iterations"     --> forward passes used for the latency comparisons
+ *      "precision"                 --> "float32" or "bfloat16". bf16 is only used if the cpu supports
+ *                                      AVX512_BF16/AMX (unless "allow_emulated_bf16" is true) and
+ *                                      the outputs stay within "precision_tolerance" (max abs diff)
+ *                                      of the fp32 model on the warm-up inputs
+ *      "backend"                   --> "torchscript" or "native". "native" runs small MLP/GRU models
+ *                                      described by <model_name>.native.json without TorchScript
+ *                                      (see NativeInferenceEngine.h)
+ *      "compare_backends"          --> prints the output difference, latency and weight memory of the
+ *                                      native engine vs. the TorchScript model on the warm-up inputs
+ *      "memory_map_weights"        --> maps the weights copy-on-write from <model_name>.mmap_weights instead
+ *                                      of copying them to the heap (pages are shared between
+ *                                      instances/processes, see MemoryMappedWeights.h). On Windows
+ *                                      the mapping is read-only, in-place writes to weights crash
+ */
+struct ModelLoadSettings {
+    bool freeze{false};
+    bool optimize_for_inference{false};
+    int warmup_iterations{0};
+    std::vector<WarmupInputSpec> warmup_inputs{};
+    std::string quantization{"none"};
+    bool compare_with_fp32{false};
+    int comparison_iterations{20};
+    std::string precision{"float32"};
+    double precision_tolerance{0.05};
+    bool allow_emulated_bf16{false};
+    std::string backend{"torchscript"};
+    bool compare_backends{false};
+    bool memory_map_weights{false};
+
+    static ModelLoadSettings fromJson(const json& j) {
+        ModelLoadSettings settings;
+        settings.freeze = j.value("freeze", false);
+        settings.optimize_for_inference = j.value("optimize_for_inference", false);
+        settings.warmup_iterations = j.value("warmup_iterations", 0);
+        settings.quantization = j.value("quantization", "none");
+        settings.compare_with_fp32 = j.value("compare_with_fp32", false);
+        settings.comparison_iterations = j.value("comparison_iterations", 20);
+        settings.precision = j.value("precision", "float32");
+        settings.precision_tolerance = j.value("precision_tolerance", 0.05);
+        settings.allow_emulated_bf16 = j.value("allow_emulated_bf16", false);
+        settings.backend = j.value("backend", "torchscript");
+        settings.compare_backends = j.value("compare_backends", false);
+        settings.memory_map_weights = j.value("memory_map_weights", false);
+        if (j.contains("warmup_inputs")) {
+            for (const auto& input_json : j["warmup_inputs"]) {
+                WarmupInputSpec spec;
+                spec.shape = input_json["shape"].get<std::vector<int64_t>>();
+                spec.dtype = parse_scalar_type(input_json.value("dtype", "float32"));
+                settings.warmup_inputs.push_back(spec);
+            }
+        }
+        return settings;
+    }
+};
+
+inline ModelLoadSettings get_model_load_settings(const std::string& model_name) {
+    return ModelLoadSettings::fromJson(get_model_loading_json(model_name));
+}
@@ -330,6 +330,210 @@ namespace thread_configurations::APVTSMediatorThread {
 // wait time between iterations in ms
 const double waitTimeBtnIters{1};
 }
+// ======================================================================================
+// ==================       Deployment  Settings               ==========================
+// ======================================================================================
+// all keys in this block are optional, missing keys fall back to the defaults below
+inline json get_deployment_settings_json() {
+    if (loaded_json.contains("deployment_settings")) {
+        return loaded_json["deployment_settings"];
+    }
+    return json::object();
+}
+
+namespace deployment_settings {
+const json deployment_settings_json = get_deployment_settings_json();
+
+// if the DPL thread falls behind, merges the queued buffer/time-shift events so that only
+// the latest playhead metadata is passed to deploy() (note/cc/bar events are always kept)
+const bool coalesce_stale_host_events{
+    deployment_settings_json.value("coalesce_stale_host_events", false)};
+
+namespace InferenceWorkerPool {
+const json pool_json = deployment_settings_json.value("inference_worker_pool", json::object());
+// number of threads available for running inference jobs in parallel (0 --> no pool, jobs run
+// directly on the DPL thread)
+const int num_workers{pool_json.value("num_workers", 0)};
+// if true, each worker gets a deep copy of the model (only needed for models whose forward()
+// mutates module attributes), otherwise all workers share the one (frozen) module
+const bool clone_module_per_worker{pool_json.value("clone_module_per_worker", false)};
+}
+
+namespace SpeculativeGeneration {
+const json speculative_json = deployment_settings_json.value("speculative_generation", json::object());
+// if true, DeploymentThread::prepareSpeculativeBarJob() is called ahead of every new bar
+// (requires inference_worker_pool.num_workers > 0, speculative jobs never run on the DPL thread)
+const bool enable{speculative_json.value("enable", false)};
+// how long before the next bar the speculative inference should start
+const double lookahead_ms{speculative_json.value("lookahead_ms", 250.0)};
+// prints hit/miss stats every n bars (0 --> only on shutdown)
+const int print_stats_every_n_bars{speculative_json.value("print_stats_every_n_bars", 0)};
+}
+
+namespace InferenceCache {
+const json cache_json = deployment_settings_json.value("inference_cache", json::object());
+// the least recently used entries are evicted once either of the limits is reached
+const int max_entries{cache_json.value("max_entries", 64)};
+const double max_memory_mb{cache_json.value("max_memory_mb", 64.0)};
+// prints hit rate and memory usage every n lookups (0 --> only on shutdown)
+const int print_stats_every_n_lookups{cache_json.value("print_stats_every_n_lookups", 0)};
+}
+
+namespace ModelLoading {
+// settings applied to every model, entries in "per_model" (keyed by the model file name)
+// override these for a specific model
+const json model_loading_json = deployment_settings_json.value("model_loading", json::object());
+}
+
+namespace ModelHotSwap {
+const json hot_swap_json = deployment_settings_json.value("model_hot_swap", json::object());
+// if true, load() returns immediately and the model is loaded/prepared on a background thread,
+// the previous model keeps serving until the new one is ready
+const bool load_asynchronously{hot_swap_json.value("load_asynchronously", false)};
+// reloads the model automatically whenever its TorchScript file is modified
+// (only used when loading asynchronously)
+const bool reload_on_file_change{hot_swap_json.value("reload_on_file_change", false)};
+const int file_watch_interval_ms{hot_swap_json.value("file_watch_interval_ms", 1000)};
+}
+
+namespace TorchThreading {
+const json threading_json = deployment_settings_json.value("torch_threading", json::object());
+// number of threads used by libtorch within a single op / for running ops in parallel
+// (0 --> libtorch default, i.e. one thread per core)
+const int intra_op_threads{threading_json.value("intra_op_threads", 0)};
+const int inter_op_threads{threading_json.value("inter_op_threads", 0)};
+// if true, the thread counts are set once per process and shared by all plugin instances
+const bool share_process_wide_pool{threading_json.value("share_process_wide_pool", true)};
+// measures inference latency for 1..benchmark_max_threads threads once per loaded model (on the
+// model loader thread if loading asynchronously)
+// (benchmark_max_threads = 0 --> number of cores)
+const bool benchmark_thread_counts{threading_json.value("benchmark_thread_counts", false)};
+const int benchmark_max_threads{threading_json.value("benchmark_max_threads", 0)};
+const int benchmark_iterations{threading_json.value("benchmark_iterations", 20)};
+}
+
+namespace Deadlines {
+const json deadlines_json = deployment_settings_json.value("deadlines", json::object());
+// what to do with generations that are ready after the start of the next bar:
+// "keep" (send anyway), "drop" (don't send) or "reanchor" (shift to the next bar(s))
+const std::string miss_policy{deadlines_json.value("miss_policy", "keep")};
+// prints the per model miss rates every n missed deadlines (0 --> only on shutdown)
+const int print_stats_every_n_misses{deadlines_json.value("print_stats_every_n_misses", 0)};
+}
+
+namespace ModelSharing {
+const json model_sharing_json = deployment_settings_json.value("model_sharing", json::object());
+// if true, plugin instances loading the same model file (with the same model_loading settings)
+// share a single prepared module instead of loading their own copy
+const bool share_across_instances{model_sharing_json.value("share_across_instances", false)};
+}
+
+namespace ModelState {
+const json model_state_json = deployment_settings_json.value("model_state", json::object());
+// when to clear the recurrent states / kv caches kept in DeploymentThread::modelState
+// (the state is always released when a new model is installed)
+const bool reset_on_playback_stop{model_state_json.value("reset_on_playback_stop", true)};
+const bool reset_on_backward_jump{model_state_json.value("reset_on_backward_jump", true)};
+const bool reset_on_preset_load{model_state_json.value("reset_on_preset_load", true)};
+const bool print_resets{model_state_json.value("print_resets", false)};
+}
+
+namespace EventHistory {
+const json event_history_json = deployment_settings_json.value("event_history", json::object());
+// max number of events kept in DeploymentThread::eventHistory
+const int max_events{event_history_json.value("max_events", 4096)};
+// events older than this (relative to the latest event) are evicted (0 --> only max_events applies)
+const double horizon_in_quarter_notes{event_history_json.value("horizon_in_quarter_notes", 64.0)};
+// new buffer events arrive every audio buffer, only record them if needed
+const bool record_new_buffer_events{event_history_json.value("record_new_buffer_events", false)};
+}
+
+namespace Cancellation {
+const json cancellation_json = deployment_settings_json.value("cancellation", json::object());
+// cancel the running deploy() call (see CancellationToken.h) when newer input of the following kinds is queued
+const bool enable{cancellation_json.value("enable", false)};
+const bool cancel_on_note_events{cancellation_json.value("cancel_on_note_events", true)};
+const bool cancel_on_gui_changes{cancellation_json.value("cancel_on_gui_changes", true)};
+const bool cancel_on_playback_stop{cancellation_json.value("cancel_on_playback_stop", true)};
+const bool print_cancellations{cancellation_json.value("print_cancellations", false)};
+}
+
+namespace ThreadScheduling {
+// per thread ("DeploymentThread", "APVTSMediatorThread", "torch_workers") scheduling settings,
+// parsed by get_thread_scheduling_settings() in ThreadScheduling.h
+const json thread_scheduling_json = deployment_settings_json.value("thread_scheduling", json::object());
+}
+
+namespace InferenceGovernor {
+const json governor_json = deployment_settings_json.value("inference_governor", json::object());
+// if enabled, all plugin instances in the process share one inference budget (see InferenceGovernor.h)
+const bool enable{governor_json.value("enable", false)};
+// max number of forward() calls running at the same time across instances (0 --> number of cores)
+const int max_concurrent_inferences{governor_json.value("max_concurrent_inferences", 0)};
+// fraction of the total cpu time (all cores) inference may use within window_ms (<= 0 --> no limit)
+const double cpu_budget_fraction{governor_json.value("cpu_budget_fraction", 0.8)};
+const int window_ms{governor_json.value("window_ms", 100)};
+}
+
+namespace ExecutionContext {
+const json execution_context_json = deployment_settings_json.value("execution_context", json::object());
+// deploy(), the inference jobs (worker pool, deployAsync()) and prepareSpeculativeBarJob() run under
+// torch::InferenceMode. Tensors created there are inference tensors: they can't be used for autograd
+// and can only be modified in place inside InferenceMode (e.g. ModelState values updated by a job)
+const bool inference_mode{execution_context_json.value("inference_mode", true)};
+// temporary CPU tensors created on the DPL thread during deploy() are bump-allocated from a
+// preallocated arena that is rewound after every call (see TensorArena.h)
+const bool tensor_arena{execution_context_json.value("tensor_arena", false)};
+const double arena_size_mb{execution_context_json.value("arena_size_mb", 16.0)};
+// prints the arena usage every n deploy() calls (0 --> only on shutdown)
+const int print_arena_stats_every_n_calls{execution_context_json.value("print_arena_stats_every_n_calls", 0)};
+}
+
+namespace Profiling {
+const json profiling_json = deployment_settings_json.value("profiling", json::object());
+// records num_deploy_calls deploy() calls (after skipping the first skip_first_n_calls) of every
+// installed model with the libtorch profiler and writes <model_name>.trace.json next to the model
+const bool enable{profiling_json.value("enable", false)};
+const int skip_first_n_calls{profiling_json.value("skip_first_n_calls", 5)};
+const int num_deploy_calls{profiling_json.value("num_deploy_calls", 20)};
+const bool record_shapes{profiling_json.value("record_shapes", true)};
+const bool profile_memory{profiling_json.value("profile_memory", true)};
+// number of operators printed once the trace is written (0 --> none)
+const int print_top_n_ops{profiling_json.value("print_top_n_ops", 15)};
+}
+
+namespace LogitsSampler {
+const json logits_sampler_json = deployment_settings_json.value("logits_sampler", json::object());
+// seed of DeploymentThread::logitsSampler (0 --> random seed)
+const uint64_t seed{logits_sampler_json.value("seed", (uint64_t) 0)};
+// compares the sampler against the equivalent chain of torch ops when the DPL thread starts
+const bool benchmark_on_start{logits_sampler_json.value("benchmark_on_start", false)};
+const int benchmark_vocab_size{logits_sampler_json.value("benchmark_vocab_size", 512)};
+const int benchmark_iterations{logits_sampler_json.value("benchmark_iterations", 200)};
+}
+
+namespace AsyncDeploy {
+const json async_deploy_json = deployment_settings_json.value("async_deploy", json::object());
+// run() calls the coroutine DeploymentThread::deployAsync() instead of deploy() (needs a C++20 build).
+// Inference only runs in the background on the worker pool, so at least 1 worker is started
+// even if inference_worker_pool.num_workers is 0
+const bool enable{async_deploy_json.value("enable", false)};
+// how often the DPL loop checks for new input while deployAsync() waits for inference
+const int poll_interval_ms{std::max(1, async_deploy_json.value("poll_interval_ms", 1))};
+}
+}
+
+// returns the model_loading settings for the given model, with the per_model overrides applied
+inline json get_model_loading_json(const std::string& model_name) {
+    auto settings = deployment_settings::ModelLoading::model_loading_json;
+    auto per_model = settings.value("per_model", json::object());
+    settings.erase("per_model");
+    if (per_model.contains(model_name)) {
+        settings.merge_patch(per_model[model_name]);
+    }
+    return settings;
+}
+
 // ======================================================================================
 // ==================       QUEUE  Settings                  ============================
 // ======================================================================================
@@ -359,6 +563,10 @@ const bool print_input_events{
     loaded_json["debugging_settings"]["DeploymentThread"]["print_input_events"]};                        // print the input events
 const bool print_deploy_method_time{
     loaded_json["debugging_settings"]["DeploymentThread"]["print_deploy_method_time"]};                    // print the time taken to deploy the model
+const bool print_coalesced_events{
+    loaded_json["debugging_settings"]["DeploymentThread"].value("print_coalesced_events", false)};                    // print the number of stale events merged before deploy
+const int print_deploy_latency_every_n_calls{
+    loaded_json["debugging_settings"]["DeploymentThread"].value("print_deploy_latency_every_n_calls", 0)};        // print p50/p95/p99 of every deploy stage (0 --> only on shutdown)
 const bool disable_user_print_requests{
     loaded_json["debugging_settings"]["DeploymentThread"]["disable_user_print_requests"]};                // disable all user requested prints
 }
@@ -317,6 +317,11 @@ struct PlaybackSequence {
         return messageSequence;
     }
 
+    // moves all events by delta (in the same time unit as the playback policy)
+    [[maybe_unused]] void shiftAllEventsBy(double delta) {
+        messageSequence.addTimeToMessages(delta);
+    }
+
 private:
     juce::MidiMessageSequence messageSequence{};
 
@@ -204,6 +204,16 @@ struct BufferMetaData {
         }
     }
 
+    // quarter note position of the first bar start after ppq (-1 if the time signature is unknown)
+    // bars are counted from ppq_position_of_last_bar_start, so time signature changes and pickups
+    // are taken into account (falls back to bars counted from ppq 0 if the host doesn't report it)
+    [[nodiscard]] double nextBarStartInQuarterNotes(double ppq) const {
+        if (numerator <= 0 || denominator <= 0) { return -1; }
+        auto bar_length = numerator * 4.0 / denominator;
+        auto last_bar_start = ppq_position_of_last_bar_start >= 0 ? ppq_position_of_last_bar_start : 0.0;
+        return last_bar_start + (std::floor((ppq - last_bar_start) / bar_length) + 1) * bar_length;
+    }
+
     bool operator==(const BufferMetaData &e) const {
         return (qpm == e.qpm) && (numerator == e.numerator) && (denominator == e.denominator) &&
                (isPlaying == e.isPlaying) && (isRecording == e.isRecording) &&
@@ -0,0 +1,289 @@
+#pragma once
+
+#include "shared_plugin_helpers/shared_plugin_helpers.h"
+#include <torch/script.h> // One-stop header.
+#include "Configs_Parser.h"
+#include "colored_cout.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if JUCE_LINUX
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if JUCE_LINUX || JUCE_MAC
+#include <sys/mman.h>
+#endif
+
+/*
+ * Scheduling of the plugin's background threads (see deployment_settings.thread_scheduling).
+ *
+ *      priority            --> juce::Thread priority used by startThread() ("default", "background",
+ *                              "low", "normal", "high" or "highest"), on macOS this selects the QoS class
+ *      scheduling_policy   --> Linux only: "default" (unchanged), "other", "batch", "idle", "fifo" or "rr"
+ *      realtime_priority   --> Linux only: 1..99, used with "fifo" and "rr"
+ *      nice                --> Linux only: per-thread nice value (-20..19, null --> unchanged)
+ *      cpu_affinity        --> cores the thread is pinned to (empty --> no pinning)
+ *      lock_model_memory   --> DeploymentThread only: mlock() the weights of the served model so that
+ *                              they can't be paged out (Linux and macOS, TorchScript models that are
+ *                              not frozen/optimized for inference, whose weights are graph constants)
+ *
+ * Real-time policies, negative nice values and mlock() usually need extra privileges
+ * (CAP_SYS_NICE, RLIMIT_RTPRIO, RLIMIT_MEMLOCK). Settings that can't be applied are reported
+ * and skipped, the thread keeps running with whatever could be applied.
+ */
+struct ThreadSchedulingSettings {
+    std::string priority{"default"};
+    std::string scheduling_policy{"default"};
+    int realtime_priority{1};
+    std::optional<int> nice;
+    std::vector<int> cpu_affinity;
+    bool lock_model_memory{false};
+
+    static ThreadSchedulingSettings fromJson(const json& settings_json) {
+        ThreadSchedulingSettings settings;
+        settings.priority = settings_json.value("priority", settings.priority);
+        settings.scheduling_policy = settings_json.value("scheduling_policy", settings.scheduling_policy);
+        settings.realtime_priority = settings_json.value("realtime_priority", settings.realtime_priority);
+        if (settings_json.contains("nice") && settings_json["nice"].is_number_integer()) {
+            settings.nice = settings_json["nice"].get<int>();
+        }
+        settings.cpu_affinity = settings_json.value("cpu_affinity", settings.cpu_affinity);
+        settings.lock_model_memory = settings_json.value("lock_model_memory", settings.lock_model_memory);
+        return settings;
+    }
+};
+
+// thread_name: "DeploymentThread", "APVTSMediatorThread" or "torch_workers"
+inline ThreadSchedulingSettings get_thread_scheduling_settings(const std::string& thread_name) {
+    return ThreadSchedulingSettings::fromJson(
+        deployment_settings::ThreadScheduling::thread_scheduling_json.value(thread_name, json::object()));
+}
+
+// priority to pass to juce::Thread::startThread()
+inline juce::Thread::Priority get_juce_thread_priority(const ThreadSchedulingSettings& settings) {
+    if (settings.priority == "background") { return juce::Thread::Priority::background; }
+    if (settings.priority == "low") { return juce::Thread::Priority::low; }
+    if (settings.priority == "high") { return juce::Thread::Priority::high; }
+    if (settings.priority == "highest") { return juce::Thread::Priority::highest; }
+    return juce::Thread::Priority::normal;
+}
+
+// ============================================================================================================
+// ===          CPU Affinity
+// ============================================================================================================
+// Pins the calling thread to the given cores. Threads created afterwards by this thread
+// (e.g. libtorch's intra-op pool, if this thread is the first to run a parallel op) inherit
+// the mask on Linux. Returns false if the mask couldn't be applied (e.g. not supported on macOS).
+inline bool set_current_thread_affinity(const std::vector<int>& cores) {
+    if (cores.empty()) { return true; }
+
+#if JUCE_LINUX
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (auto core : cores) {
+        if (core >= 0 && core < CPU_SETSIZE) { CPU_SET(core, &cpu_set); }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set) == 0;
+#elif JUCE_WINDOWS
+    juce::uint32 mask = 0;
+    for (auto core : cores) {
+        if (core >= 0 && core < 32) { mask |= (juce::uint32(1) << core); }
+    }
+    juce::Thread::setCurrentThreadAffinityMask(mask);
+    return true;
+#else
+    return false;
+#endif
+}
+
+// ============================================================================================================
+// ===          Applying the Settings
+// ============================================================================================================
+// Applies the settings to the calling thread (except `priority`, which is passed to startThread())
+// and prints the effective scheduling. prefix: e.g. "[DPL]"
+inline void apply_thread_scheduling(const ThreadSchedulingSettings& settings, const std::string& prefix) {
+    auto warn = [&prefix](const std::string& message) {
+        std::cout << clr::yellow << prefix << " " << message << std::endl;
+    };
+
+#if JUCE_LINUX
+    if (settings.scheduling_policy != "default") {
+        int policy = -1;
+        if (settings.scheduling_policy == "other") { policy = SCHED_OTHER; }
+        else if (settings.scheduling_policy == "batch") { policy = SCHED_BATCH; }
+        else if (settings.scheduling_policy == "idle") { policy = SCHED_IDLE; }
+        else if (settings.scheduling_policy == "fifo") { policy = SCHED_FIFO; }
+        else if (settings.scheduling_policy == "rr") { policy = SCHED_RR; }
+
+        if (policy < 0) {
+            warn("Unknown scheduling policy '" + settings.scheduling_policy + "', keeping the default");
+        } else {
+            sched_param param{};
+            if (policy == SCHED_FIFO || policy == SCHED_RR) {
+                param.sched_priority = std::clamp(settings.realtime_priority, sched_get_priority_min(policy),
+                                                  sched_get_priority_max(policy));
+            }
+            auto result = pthread_setschedparam(pthread_self(), policy, &param);
+            if (result != 0) {
+                warn("Couldn't set scheduling policy '" + settings.scheduling_policy + "': " +
+                     std::string(strerror(result)) + " (needs CAP_SYS_NICE or RLIMIT_RTPRIO), keeping the default");
+            }
+        }
+    }
+
+    if (settings.nice.has_value()) {
+        // on Linux the nice value is per thread (addressed by its tid)
+        auto tid = (id_t) syscall(SYS_gettid);
+        if (setpriority(PRIO_PROCESS, tid, *settings.nice) != 0) {
+            warn("Couldn't set nice value " + std::to_string(*settings.nice) + ": " + strerror(errno));
+        }
+    }
+#else
+    if (settings.scheduling_policy != "default" || settings.nice.has_value()) {
+        warn("scheduling_policy and nice are only supported on Linux, use priority instead");
+    }
+#endif
+
+    if (!settings.cpu_affinity.empty() && !set_current_thread_affinity(settings.cpu_affinity)) {
+        warn("Couldn't apply the CPU affinity (not supported on this platform or invalid cores)");
+    }
+
+    // report what is actually in effect
+    std::stringstream ss;
+    ss << prefix << " thread scheduling | priority: " << settings.priority;
+#if JUCE_LINUX
+    int policy = 0;
+    sched_param param{};
+    pthread_getschedparam(pthread_self(), &policy, &param);
+    auto policy_name = policy == SCHED_FIFO ? "fifo" : policy == SCHED_RR ? "rr" : policy == SCHED_BATCH ? "batch" :
+                       policy == SCHED_IDLE ? "idle" : "other";
+    ss << " | policy: " << policy_name;
+    if (policy == SCHED_FIFO || policy == SCHED_RR) { ss << " (" << param.sched_priority << ")"; }
+    errno = 0;
+    auto nice_value = getpriority(PRIO_PROCESS, (id_t) syscall(SYS_gettid));
+    if (errno == 0) { ss << " | nice: " << nice_value; }
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set) == 0) {
+        std::vector<int> cores;
+        for (int core = 0; core < CPU_SETSIZE; core++) {
+            if (CPU_ISSET(core, &cpu_set)) { cores.push_back(core); }
+        }
+        ss << " | cores: ";
+        if ((int) cores.size() == (int) std::thread::hardware_concurrency()) {
+            ss << "all";
+        } else {
+            for (size_t i = 0; i < cores.size(); i++) { ss << (i > 0 ? "," : "") << cores[i]; }
+        }
+    }
+#else
+    if (!settings.cpu_affinity.empty()) {
+        ss << " | cores: ";
+        for (size_t i = 0; i < settings.cpu_affinity.size(); i++) {
+            ss << (i > 0 ? "," : "") << settings.cpu_affinity[i];
+        }
+    }
+#endif
+    std::cout << clr::green << ss.str() << std::endl;
+}
+
+// ============================================================================================================
+// ===          Locking Model Memory
+// ============================================================================================================
+/*
+ * Keeps the given tensors resident in RAM (mlock) until release() is called or the object is
+ * destroyed. The tensors are held, so their memory stays valid while locked.
+ *
+ * munlock() unlocks a page no matter how often it was locked, and models shared across instances
+ * (see SharedModelRegistry) are locked by every instance serving them. The locks are therefore
+ * counted per memory range, process wide: a range is only unlocked once the last instance
+ * holding it releases it.
+ */
+class LockedTensorMemory {
+public:
+    LockedTensorMemory() = default;
+    ~LockedTensorMemory() { release(); }
+
+    LockedTensorMemory(const LockedTensorMemory&) = delete;
+    LockedTensorMemory& operator=(const LockedTensorMemory&) = delete;
+
+    // returns false if (some of) the memory couldn't be locked
+    bool lock(const std::vector<torch::Tensor>& tensors) {
+        release();
+#if JUCE_LINUX || JUCE_MAC
+        bool all_locked = true;
+        std::lock_guard<std::mutex> guard(registry_mutex());
+        for (const auto& tensor : tensors) {
+            if (!tensor.defined() || tensor.nbytes() == 0) { continue; }
+            auto& count = lock_counts()[{tensor.data_ptr(), tensor.nbytes()}];
+            if (count > 0 || mlock(tensor.data_ptr(), tensor.nbytes()) == 0) {
+                count++;
+                locked_tensors.push_back(tensor);
+                num_locked_bytes += tensor.nbytes();
+            } else {
+                lock_counts().erase({tensor.data_ptr(), tensor.nbytes()});
+                all_locked = false;
+            }
+        }
+        return all_locked;
+#else
+        juce::ignoreUnused(tensors);
+        return false;
+#endif
+    }
+
+    void release() {
+#if JUCE_LINUX || JUCE_MAC
+        std::lock_guard<std::mutex> guard(registry_mutex());
+        for (const auto& tensor : locked_tensors) {
+            auto it = lock_counts().find({tensor.data_ptr(), tensor.nbytes()});
+            if (it == lock_counts().end() || --it->second > 0) { continue; }
+            munlock(tensor.data_ptr(), tensor.nbytes());
+            lock_counts().erase(it);
+        }
+#endif
+        locked_tensors.clear();
+        num_locked_bytes = 0;
+    }
+
+    [[nodiscard]] size_t getNumLockedBytes() const { return num_locked_bytes; }
+
+private:
+    std::vector<torch::Tensor> locked_tensors;
+    size_t num_locked_bytes{0};
+
+    // number of LockedTensorMemory objects holding each locked (address, size) range
+    static std::map<std::pair<const void*, size_t>, int>& lock_counts() {
+        static std::map<std::pair<const void*, size_t>, int> counts;
+        return counts;
+    }
+
+    static std::mutex& registry_mutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+};
+
+// all tensors (parameters, buffers and other tensor attributes) of the module and its submodules
+inline std::vector<torch::Tensor> get_module_tensors(const torch::jit::script::Module& module) {
+    std::vector<torch::Tensor> tensors;
+    for (const auto& attribute : module.named_attributes(/*recurse=*/true)) {
+        if (attribute.value.isTensor()) { tensors.push_back(attribute.value.toTensor()); }
+    }
+    return tensors;
+}
@@ -5,6 +5,10 @@
 # pragma once
 
 
+#include <filesystem>
+#include <mutex>
+#include <unordered_map>
+
 #define STRINGIFY(x) #x
 #define TOSTRING(x) STRINGIFY(x)
 inline const char* default_processing_scripts_path = TOSTRING(DEFAULT_PROCESSING_SCRIPTS_DIR);
@@ -23,25 +27,43 @@ inline std::string stripQuotes(const std::string &input) {
     return input;
 }
 
+/*
+ * Processing scripts are compiled once per process and shared by all instances/threads.
+ * A script is reloaded only if its file's modification time changes. The returned module
+ * refers to the cached one, so don't modify its attributes.
+ */
 inline torch::jit::Module load_processing_script(const std::string& script_name) {
+    struct CachedScript {
+        torch::jit::Module module;
+        std::filesystem::file_time_type last_write_time;
+    };
+    static std::unordered_map<std::string, CachedScript> cache;
+    static std::mutex cache_mutex;
+
     std::string script_path = stripQuotes(std::string(default_processing_scripts_path)) +
                               std::string(path_separator) +
                               script_name;
 
-    ifstream myFile;
-    myFile.open(script_path);
-    if (myFile.is_open())
-    {
-        cout << "Processing Script found at: " + script_path << " -- Trying to load script..."
-             << endl;
-        myFile.close();
+    std::error_code ec;
+    auto last_write_time = std::filesystem::last_write_time(script_path, ec);
 
-    } else {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = cache.find(script_name);
+    if (it != cache.end() && (ec || it->second.last_write_time == last_write_time)) {
+        return it->second.module;
+    }
+
+    if (ec) {
         cout << "Processing Script not found at: " + script_path << endl;
         cout << "Make sure the script is available in TorchScripts/ProcessingScripts folder" << endl;
+    } else {
+        cout << "Processing Script found at: " + script_path << " -- Trying to load script..."
+             << endl;
     }
 
-    return torch::jit::load(script_path);
+    auto module = torch::jit::load(script_path);
+    cache[script_name] = CachedScript{module, last_write_time};
+    return module;
 }
 
 inline void save_tensor_map(const std::map<std::string, torch::Tensor>& m, const std::string& file_name) {
@@ -83,8 +105,7 @@ inline void save_tensor_map(const std::map<std::string, torch::Tensor>& m, const
 }
 
 
-inline std::map<std::string, torch::Tensor> load_tensor_map(const std::string& file_name) {
-    std::string fp = stripQuotes(default_preset_dir) + path_separator + file_name;
+inline std::map<std::string, torch::Tensor> load_tensor_map_from_path(const std::string& fp) {
     std::ifstream in_file(fp, std::ios::in | std::ios::binary);
     std::map<std::string, torch::Tensor> m;
 
@@ -125,6 +146,11 @@ inline std::map<std::string, torch::Tensor> load_tensor_map(const std::string& f
     return m;
 }
 
+inline std::map<std::string, torch::Tensor> load_tensor_map(const std::string& file_name) {
+    std::string fp = stripQuotes(default_preset_dir) + path_separator + file_name;
+    return load_tensor_map_from_path(fp);
+}
+
 #include <mutex>
 
 class CustomPresetDataDictionary
@@ -11,17 +11,18 @@
 using namespace std;
 #include <chrono>
 
-using sys_time = std::optional<std::chrono::time_point<std::chrono::system_clock>>;
+// steady_clock: monotonic, not affected by system time adjustments
+using steady_time = std::optional<std::chrono::time_point<std::chrono::steady_clock>>;
 
 struct chrono_timer {
     chrono_timer() = default;
 
     void registerStartTime() {
-        startTime = std::chrono::system_clock::now();
+        startTime = std::chrono::steady_clock::now();
     }
 
     void registerEndTime() {
-        endTime = std::chrono::system_clock::now();
+        endTime = std::chrono::steady_clock::now();
     }
 
     std::optional<string> getDescription(const string& text=" | Duration : ") const{
@@ -31,20 +32,23 @@ struct chrono_timer {
         if (!isValid()) {
             return std::nullopt;
         } else {
-            auto duration = *endTime - *startTime;
-            auto duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+            auto duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(*endTime - *startTime).count();
             ss << text << std::to_string(duration_ms) + " (ms)";
         }
         return ss.str();
     }
 
+    // returns 0 if either of start/end times is not registered
+    int64_t getDurationInNanoseconds() const {
+        if (!isValid()) { return 0; }
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(*endTime - *startTime).count();
+    }
+
     bool isValid() const {
         return startTime && endTime;
     }
 private:
 
-    sys_time startTime{std::nullopt};
-    sys_time endTime{std::nullopt};
+    steady_time startTime{std::nullopt};
+    steady_time endTime{std::nullopt};
 };
-
-